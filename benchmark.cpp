@@ -0,0 +1,397 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014-2019 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Micro benchmarks that compare each operation on a RangeConstrained subtype
+ * with the same operation on its plain base type. Build it with different
+ * optimization levels and modes (see the "bench" target of the Makefile) to
+ * compare e.g. -O0, -Og and -O2 with and without CT_DEBUG_PERF. On Linux the
+ * cycles, instructions, branches, branch misses and L1 data cache misses per
+ * operation are read with perf_event_open when they are permitted. The last
+ * table compares the check policies: the time to store a value and the share
+ * of out of range values that are detected.
+ *
+ * Usage: benchmark.out [label]
+ */
+
+#include "subtype_range_constrained.h"
+#include "subtype_range_constrained_switch.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+using namespace std;
+
+typedef ct::RangeConstrained<int, 0, 1000000> bench_t;
+
+static const size_t DATA_SIZE = 4096;
+static const size_t ROUNDS    = 2000;
+
+/// Keeps the compiler from discarding a computed value.
+template <typename V>
+inline void do_not_optimize(V const& v) {
+#if defined(__GNUC__)
+  asm volatile("" : : "r,m"(v) : "memory");
+#else
+  static volatile V sink;
+  sink = v;
+#endif
+}
+
+static vector<int> make_data() {
+  vector<int> data(DATA_SIZE);
+  for (size_t i = 0; i < DATA_SIZE; ++i) {
+    data[i] = (int)((i * 2654435761u) % 1000);
+  }
+  return data;
+}
+
+/////////////////////////////////////////////////
+///                                           ///
+/// Scenarios, each one is templated on the   ///
+/// value type so raw T and the subtype run   ///
+/// exactly the same code.                    ///
+///                                           ///
+/////////////////////////////////////////////////
+
+/// Construction from the base type (the checking constructor).
+template <class V>
+void scenario_assign(const vector<int>& src) {
+  vector<V> dst(DATA_SIZE);
+  for (size_t r = 0; r < ROUNDS; ++r) {
+    for (size_t i = 0; i < DATA_SIZE; ++i) {
+      dst[i] = src[i];
+    }
+    do_not_optimize(dst[r % DATA_SIZE]);
+  }
+}
+
+/// Compound assignment operators.
+template <class V>
+void scenario_compound(const vector<int>& src) {
+  V acc = 1000;
+  for (size_t r = 0; r < ROUNDS; ++r) {
+    for (size_t i = 0; i < DATA_SIZE; ++i) {
+      acc += src[i];
+      do_not_optimize(acc);
+      acc -= src[i];
+    }
+    acc = 1000;
+    do_not_optimize(acc);
+  }
+}
+
+/// Prefix and postfix increment and decrement.
+template <class V>
+void scenario_increment(const vector<int>& src) {
+  V x = 500;
+  for (size_t r = 0; r < ROUNDS; ++r) {
+    for (size_t i = 0; i < DATA_SIZE; ++i) {
+      ++x;
+      do_not_optimize(x);
+      x--;
+    }
+    do_not_optimize(x);
+  }
+  (void)src;
+}
+
+/// Reading the value back through the conversion operator.
+template <class V>
+void scenario_read(const vector<int>& src) {
+  vector<V> values(src.begin(), src.end());
+  for (size_t r = 0; r < ROUNDS; ++r) {
+    long long sum = 0;
+    for (size_t i = 0; i < DATA_SIZE; ++i) {
+      sum += values[i];
+    }
+    do_not_optimize(sum);
+  }
+}
+
+/////////////////////////////////////////////////
+///                                           ///
+/// Sampled checking, the cost of storing a   ///
+/// value against the share of violations     ///
+/// that are detected.                        ///
+///                                           ///
+/////////////////////////////////////////////////
+
+template <unsigned Period>
+struct sampled_t {
+  typedef ct::RangeConstrained<int, 0, 1000000, ct::sampled<Period> > type;
+};
+
+/// One in INJECT_EVERY values is out of range.
+static const size_t INJECT_EVERY = 97;
+
+/**
+ * Share of the injected violations that throw. Values that are not checked
+ * are stored anyway and break the invariant, they are never read back.
+ */
+template <class V>
+double detection_rate(const vector<int>& src) {
+  size_t injected = 0, detected = 0;
+  for (size_t r = 0; r < ROUNDS / 10; ++r) {
+    for (size_t i = 0; i < DATA_SIZE; ++i) {
+      bool bad = (r * DATA_SIZE + i) % INJECT_EVERY == 0;
+      injected += bad ? 1 : 0;
+      try {
+        V v = bad ? -src[i] - 1 : src[i];
+        do_not_optimize(v);
+      } catch (const ct::constraint_error_base&) {
+        detected++;
+      }
+    }
+  }
+  return injected == 0 ? 0.0 : (double)detected / (double)injected;
+}
+
+typedef ct::RangeConstrained<int, 0, 1000000, ct::switchable> switched_t;
+
+/// Runs a scenario of switched_t with its checks switched on or off.
+template <bool On>
+void switched_assign(const vector<int>& src) {
+  ct::set_checks_enabled(On);
+  scenario_assign<switched_t>(src);
+  ct::set_checks_enabled(false);
+}
+
+template <bool On>
+double switched_detection(const vector<int>& src) {
+  ct::set_checks_enabled(On);
+  double rate = detection_rate<switched_t>(src);
+  ct::set_checks_enabled(false);
+  return rate;
+}
+
+typedef void (*scenario_fn)(const vector<int>&);
+
+struct Scenario {
+  const char *name;
+  scenario_fn raw;
+  scenario_fn constrained;
+};
+
+/////////////////////////////////////////////////
+///                                           ///
+/// Hardware performance counters             ///
+///                                           ///
+/////////////////////////////////////////////////
+
+static const size_t COUNTER_COUNT = 5;
+static const char *const COUNTER_NAMES[COUNTER_COUNT] = {
+  "cycles", "instrs", "branches", "br-miss", "l1d-miss"
+};
+
+/**
+ * Counters of this thread in user space, read with perf_event_open. Each one
+ * is opened on its own, so a counter that the machine or the permissions
+ * (kernel.perf_event_paranoid) do not allow is reported as missing and the
+ * others still work.
+ */
+class hw_counters {
+private:
+  int _fds[COUNTER_COUNT];
+
+#if defined(__linux__)
+  static int open_counter(unsigned type, unsigned long long config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+#endif
+
+public:
+  hw_counters() {
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+      _fds[i] = -1;
+    }
+#if defined(__linux__)
+    _fds[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    _fds[1] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    _fds[2] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+    _fds[3] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    _fds[4] = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                           (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif
+  }
+
+  ~hw_counters() {
+#if defined(__linux__)
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+      if (_fds[i] >= 0) {
+        close(_fds[i]);
+      }
+    }
+#endif
+  }
+
+  bool any() const {
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+      if (_fds[i] >= 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void start() {
+#if defined(__linux__)
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+      if (_fds[i] >= 0) {
+        ioctl(_fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+
+  /// Counts since start(), -1 for the missing counters.
+  void stop(long long counts[COUNTER_COUNT]) {
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+      counts[i] = -1;
+#if defined(__linux__)
+      long long value;
+      if (_fds[i] >= 0) {
+        ioctl(_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(_fds[i], &value, sizeof(value)) == (ssize_t)sizeof(value)) {
+          counts[i] = value;
+        }
+      }
+#endif
+    }
+  }
+};
+
+/// Runs fn with the counters enabled, counts are per operation.
+static void count_per_op(hw_counters& hw, scenario_fn fn, const vector<int>& data,
+                         double per_op[COUNTER_COUNT]) {
+  long long counts[COUNTER_COUNT];
+  hw.start();
+  fn(data);
+  hw.stop(counts);
+  for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+    per_op[i] = counts[i] < 0 ? -1.0 : (double)counts[i] / (double)(ROUNDS * DATA_SIZE);
+  }
+}
+
+static void print_counters(const char *name, const double per_op[COUNTER_COUNT]) {
+  printf("%-16s", name);
+  for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+    if (per_op[i] < 0) {
+      printf(" %9s", "-");
+    } else {
+      printf(" %9.3f", per_op[i]);
+    }
+  }
+  printf("\n");
+}
+
+static double ns_per_op(scenario_fn fn, const vector<int>& data) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  fn(data);
+  chrono::steady_clock::time_point end = chrono::steady_clock::now();
+  double ns = (double)chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+  return ns / (double)(ROUNDS * DATA_SIZE);
+}
+
+int main(int argc, char *argv[]) {
+  ct::enable_check_patching();
+  const Scenario scenarios[] = {
+    { "assign",    scenario_assign<int>,    scenario_assign<bench_t>    },
+    { "compound",  scenario_compound<int>,  scenario_compound<bench_t>  },
+    { "increment", scenario_increment<int>, scenario_increment<bench_t> },
+    { "read",      scenario_read<int>,      scenario_read<bench_t>      },
+  };
+  vector<int> data = make_data();
+
+  printf("== %s ==\n", argc > 1 ? argv[1] : "benchmark");
+  printf("%-12s %12s %12s %8s\n", "scenario", "raw ns/op", "ct ns/op", "ratio");
+  for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+    double raw = ns_per_op(scenarios[i].raw, data);
+    double constrained = ns_per_op(scenarios[i].constrained, data);
+    printf("%-12s %12.3f %12.3f %8.2f\n", scenarios[i].name, raw, constrained,
+           raw > 0 ? constrained / raw : 0.0);
+  }
+
+  hw_counters hw;
+  if (hw.any()) {
+    printf("%-16s", "per op");
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+      printf(" %9s", COUNTER_NAMES[i]);
+    }
+    printf("\n");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+      double per_op[COUNTER_COUNT];
+      string name = scenarios[i].name;
+      count_per_op(hw, scenarios[i].raw, data, per_op);
+      print_counters((name + " raw").c_str(), per_op);
+      count_per_op(hw, scenarios[i].constrained, data, per_op);
+      print_counters((name + " ct").c_str(), per_op);
+    }
+  } else {
+    printf("hardware counters are not available, see kernel.perf_event_paranoid\n");
+  }
+
+  const struct {
+    const char *name;
+    scenario_fn assign;
+    double (*detection)(const vector<int>&);
+  } policies[] = {
+    { "always",     scenario_assign<bench_t>,                 detection_rate<bench_t>                 },
+    { "sampled<4>", scenario_assign<sampled_t<4>::type>,      detection_rate<sampled_t<4>::type>      },
+    { "sampled<16>", scenario_assign<sampled_t<16>::type>,    detection_rate<sampled_t<16>::type>     },
+    { "sampled<64>", scenario_assign<sampled_t<64>::type>,    detection_rate<sampled_t<64>::type>     },
+    { "switch off",  switched_assign<false>,                  switched_detection<false>               },
+    { "switch on",   switched_assign<true>,                   switched_detection<true>                },
+  };
+  printf("%-12s %12s %12s\n", "policy", "ct ns/op", "detected");
+  printf("%-12s %12.3f %12s\n", "raw", ns_per_op(scenario_assign<int>, data), "-");
+  for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); ++i) {
+    double ns = ns_per_op(policies[i].assign, data);
+    printf("%-12s %12.3f %11.1f%%\n", policies[i].name, ns, 100.0 * policies[i].detection(data));
+  }
+  return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014-2019 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Canonical kernels whose generated code is checked by the "codegen-test"
+ * target of the Makefile. Each kernel on a subtype has a twin on the plain
+ * base type; the counts of their instructions and branches are compared with
+ * the golden files in codegen/, so a change to range_check or to the
+ * operators can not make the generated code worse without being noticed.
+ *
+ * The kernels have C linkage so that their names do not depend on the
+ * compiler's mangling.
+ */
+
+#include "subtype_range_constrained.h"
+#include <cstddef>
+
+typedef ct::RangeConstrained<int, 0, 1000000> amount_t;
+typedef ct::RangeConstrained<int, 0, 255> index_t;
+typedef ct::RangeConstrained<short, 1, 12> month_t;
+
+extern "C" {
+
+/// Reading: must be the same code as for int.
+long long sum_raw(const int* values, size_t n) {
+  long long sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += values[i];
+  }
+  return sum;
+}
+
+long long sum_ct(const amount_t* values, size_t n) {
+  long long sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += values[i];
+  }
+  return sum;
+}
+
+/// Indexing with a value of a subtype: must be the same code as for int.
+int index_raw(const int* table, int i) {
+  return table[i];
+}
+
+int index_ct(const int* table, index_t i) {
+  return table[i];
+}
+
+/// Checked conversion: one compare and one branch to the cold throw path.
+short convert_raw(int x) {
+  return (short)x;
+}
+
+short convert_ct(int x) {
+  month_t m = (short)x;
+  return m;
+}
+
+/// Compound assignment: the same, after the addition.
+int add_raw(int x, int delta) {
+  x += delta;
+  return x;
+}
+
+int add_ct(amount_t x, int delta) {
+  x += delta;
+  return x;
+}
+
+}
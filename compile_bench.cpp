@@ -0,0 +1,55 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014-2019 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * A typical translation unit that includes the library. It is compiled by the
+ * "compile-bench" target of the Makefile to measure how much the header adds
+ * to preprocessing and compile time.
+ */
+
+#include "subtype_range_constrained.h"
+
+typedef ct::RangeConstrained<short, 1, 12> month_t;
+typedef ct::RangeConstrained<char, 'a', 'z'> lower_alpha_t;
+typedef ct::RangeConstrained<int, -2000, 100000> altitude_t;
+
+int next_month(int m) {
+  month_t month = m;
+  return ++month;
+}
+
+char to_lower_alpha(char c) {
+  lower_alpha_t alpha = c;
+  return alpha;
+}
+
+int climb(int altitude, int delta) {
+  altitude_t a = altitude;
+  a += delta;
+  return a;
+}
@@ -48,60 +48,448 @@
 #ifndef SUBTYPE_RANGE_CONSTRAINED_H
 #define SUBTYPE_RANGE_CONSTRAINED_H
 
-#include <stdexcept>
-#include <sstream>
-#include <string>
 #include <limits>
+#include <type_traits>
+#include "subtype_range_constrained_error.h"
+
+/**
+ * Hot members are declared with CT_HOT and the throw path with CT_COLD.
+ *
+ * Defining CT_DEBUG_PERF before including this header forces the hot members
+ * to be inlined even at -O0/-Og and marks them as artificial, so debuggers step
+ * over them as if they were built-in operators. Without it they are plain
+ * inline functions and the optimizer decides.
+ */
+#if defined(__GNUC__)
+#  define CT_COLD __attribute__((noinline, cold))
+#  define CT_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#  define CT_RETURN_ADDRESS() __builtin_return_address(0)
+#else
+#  define CT_COLD
+#  define CT_UNLIKELY(x) (x)
+#  define CT_RETURN_ADDRESS() ((void*)0)
+#endif
+
+#if defined(CT_DEBUG_PERF) && defined(__GNUC__)
+#  define CT_HOT __attribute__((always_inline, artificial)) inline
+#else
+#  define CT_HOT inline
+#endif
+
+/// Members that contain statements can only be constexpr since C++14.
+#if defined(__cpp_constexpr) && __cpp_constexpr >= 201304L
+#  define CT_CONSTEXPR14 constexpr
+#else
+#  define CT_CONSTEXPR14
+#endif
+
+/// Tells the optimizer that x holds, the behavior is undefined when it does not.
+#if defined(__clang__)
+#  define CT_ASSUME(x) __builtin_assume(x)
+#elif defined(__GNUC__)
+#  define CT_ASSUME(x) do { if (!(x)) __builtin_unreachable(); } while (false)
+#else
+#  define CT_ASSUME(x) ((void)0)
+#endif
+
+#if defined(__has_builtin)
+#  define CT_HAS_BUILTIN(x) __has_builtin(x)
+#else
+#  define CT_HAS_BUILTIN(x) 0
+#endif
+
+/**
+ * Instrumentation is skipped while a constant is evaluated during compilation.
+ * GCC has the builtin since 9 but __has_builtin only since 10, clang since 9.
+ */
+#if ((defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 9) || \
+     CT_HAS_BUILTIN(__builtin_is_constant_evaluated)) && \
+    defined(__cpp_constexpr) && __cpp_constexpr >= 201304L
+#  define CT_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#else
+#  define CT_IS_CONSTANT_EVALUATED() false
+#endif
+
+/*
+ * Optional instrumentation, each one is enabled by defining its macro for the
+ * whole program:
+ *
+ * CT_TELEMETRY       - per subtype counters of checks and violations.
+ * CT_FLIGHT_RECORDER - per thread ring buffer of the last violations.
+ * CT_SOURCE_LOCATION - the checking constructors and the compound operators
+ *                      take the location of the caller, and violations are
+ *                      counted per call site.
+ * CT_USDT            - USDT probe on the throw path, CT_USDT_CHECKS adds one
+ *                      to every check.
+ * CT_ASYNC_LOG       - violations are written to a rotating file by a
+ *                      background thread.
+ * CT_SAMPLING        - one in CT_SAMPLING_PERIOD checked values is recorded
+ *                      to suggest tighter bounds.
+ * CT_PARANOID        - the stored value is checked again when it is read, to
+ *                      catch memory corruption.
+ *
+ * CT_LIGHT_EXCEPTIONS derives the constraint_error classes from std::exception
+ * instead of std::out_of_range, to keep <stdexcept> out of the includes.
+ */
+#if defined(CT_TELEMETRY)
+#  include "subtype_range_constrained_telemetry.h"
+#endif
+#if defined(CT_FLIGHT_RECORDER)
+#  include "subtype_range_constrained_recorder.h"
+#endif
+#if defined(CT_SOURCE_LOCATION)
+#  include "subtype_range_constrained_sites.h"
+#endif
+#if defined(CT_USDT) || defined(CT_USDT_CHECKS)
+#  include "subtype_range_constrained_probes.h"
+#endif
+#if defined(CT_ASYNC_LOG)
+#  include "subtype_range_constrained_logger.h"
+#endif
+#if defined(CT_SAMPLING)
+#  include "subtype_range_constrained_sampling.h"
+#endif
+#if defined(CT_PARANOID)
+#  include "subtype_range_constrained_paranoid.h"
+#endif
+
+/*
+ * CT_WHERE_PARAM is appended to the parameters of the checking constructors.
+ * With CT_SOURCE_LOCATION it is a defaulted parameter that captures the
+ * location of the caller, and CT_WHERE passes it on to range_check(), which
+ * only hands it to the throw path. Without CT_SOURCE_LOCATION all of them
+ * expand to nothing and no location is built on the hot path.
+ */
+#if defined(CT_SOURCE_LOCATION)
+#  define CT_WHERE_PARAM , const ::ConstrainedTypes::source_location& where = \
+                           ::ConstrainedTypes::source_location::current()
+#  define CT_WHERE , where
+#  define CT_WHERE_OF(operand) , ::ConstrainedTypes::detail::where_of(operand)
+#  define CT_CHECK_WHERE_PARAM , const ::ConstrainedTypes::source_location& where = \
+                                 ::ConstrainedTypes::source_location()
+#  define CT_RAISE_WHERE where.file, where.line, where.function
+#else
+#  define CT_WHERE_PARAM
+#  define CT_WHERE
+#  define CT_WHERE_OF(operand)
+#  define CT_CHECK_WHERE_PARAM
+#  define CT_RAISE_WHERE nullptr, 0, nullptr
+#endif
 
 namespace ConstrainedTypes {
 
-template<class T, T First, T Last>
-class RangeConstrained {
+/**
+ * Tag for constructing a subtype from a value that the caller already knows to
+ * be in range. No check is performed, an out of range value breaks the
+ * invariant of the subtype.
+ */
+struct unchecked_t {};
+constexpr unchecked_t unchecked = unchecked_t();
+
+namespace detail {
+
+/// Not constexpr on purpose: calling it while evaluating a constant is a compilation error.
+inline void constant_is_out_of_range() {}
+
+/**
+ * Called by every range check of Subtype, with the value widened as by
+ * wide_traits. Enabled instrumentation hooks in here.
+ */
+template<class Subtype>
+CT_HOT void on_check(long long val) {
+#if defined(CT_TELEMETRY)
+  telemetry::count_check<Subtype>();
+#endif
+#if defined(CT_USDT_CHECKS)
+  probes::check<Subtype>(val);
+#endif
+#if defined(CT_SAMPLING)
+  sampling::count_check<Subtype>(val);
+#endif
+  (void)val;
+}
+
+/**
+ * Called on the cold path before a constraint_error of Subtype is thrown, with
+ * the value widened as by wide_traits, the address of the code that made the
+ * check and its source location. Enabled instrumentation hooks in here.
+ */
+template<class Subtype>
+inline void on_violation(long long val, const void* caller, const source_location& where) {
+#if defined(CT_TELEMETRY)
+  telemetry::count_violation<Subtype>();
+#endif
+#if defined(CT_FLIGHT_RECORDER)
+  recorder::record(Subtype::descriptor(), val, caller, where);
+#endif
+#if defined(CT_SOURCE_LOCATION)
+  sites::count_violation(Subtype::descriptor(), where);
+#endif
+#if defined(CT_USDT) || defined(CT_USDT_CHECKS)
+  probes::violation(Subtype::descriptor(), val, where);
+#endif
+#if defined(CT_ASYNC_LOG)
+  logger::enqueue(Subtype::descriptor(), val, where);
+#endif
+  (void)val;
+  (void)caller;
+  (void)where;
+}
+
+/**
+ * Operand of the compound operators. With CT_SOURCE_LOCATION it also captures
+ * the location of the operator expression, since operators can not have
+ * default arguments.
+ */
+#if defined(CT_SOURCE_LOCATION)
+template<class T>
+struct located {
+  T value;
+  source_location where;
+
+  template<class U>
+  CT_HOT constexpr located(const U& v, const source_location& w = source_location::current()) :
+    value(implicit(v)), where(w) {}
+
+private:
+  static constexpr T implicit(const T& v) { return v; }
+};
+
+template<class T>
+struct operand { typedef located<T> type; };
+
+template<class T>
+CT_HOT constexpr T value_of(const located<T>& other) { return other.value; }
+
+template<class T>
+CT_HOT constexpr const source_location& where_of(const located<T>& other) { return other.where; }
+#else
+template<class T>
+struct operand { typedef const T& type; };
+#endif
+
+template<class T>
+CT_HOT constexpr const T& value_of(const T& other) { return other; }
+
+/**
+ * Storage and read access shared by all the subtypes of T. Members that do not
+ * depend on the range live here and are instantiated once per base type.
+ */
+template<class T>
+class range_base {
+protected:
+  T _val;
+
+  CT_HOT constexpr explicit range_base(const T& val) : _val(val) {}
+
 public:
+  CT_HOT constexpr operator T () const {
+    return _val;
+  }
+};
+
+}
+
+/// Default period of ct::sampled<0>, see set_check_period().
+#ifndef CT_CHECK_PERIOD
+#  define CT_CHECK_PERIOD 16
+#endif
+
+namespace detail {
+namespace {
+
+/**
+ * Assignments left until the next check of Subtype in this thread, the first
+ * one is checked. Each translation unit has its own countdown, and its type
+ * differs in size from the base type so that the stored values can not alias
+ * it. No other function can reach it then, so the optimizer keeps it in a
+ * register across a loop instead of a read-modify-write of memory per value.
+ */
+template<class Subtype>
+struct check_countdown {
+  typedef typename std::conditional<sizeof(typename Subtype::value_type) == sizeof(unsigned long),
+                                    unsigned, unsigned long>::type type;
+  static thread_local type value;
+};
+
+template<class Subtype>
+thread_local typename check_countdown<Subtype>::type check_countdown<Subtype>::value = 1;
+
+}
+
+/**
+ * Hides the origin of val from the optimizer. GCC merges the test of an
+ * assumption into a check of the same value, which would check every value
+ * that is assumed to be in range.
+ */
+template<class T>
+CT_HOT void launder(T& val) {
+#if defined(__GNUC__) && !defined(__clang__)
+  asm("" : "+r,m"(val));
+#else
+  (void)val;
+#endif
+}
+
+inline unsigned& thread_check_period() {
+  static thread_local unsigned period = CT_CHECK_PERIOD;
+  return period;
+}
+
+}
 
-  /// Custom exception used to indicate that value was out of range.
-  class constraint_error : public std::out_of_range {
-  private:
-    const T _val, _first, _last;
-    
-    static std::string to_string( const T& n ){
-      std::ostringstream stm ;
-      stm << n ;
-      return stm.str() ;
+/**
+ * Check policies, the last template parameter of RangeConstrained. check()
+ * tells whether the value that is being stored into Subtype is checked.
+ */
+struct always_checked {
+  template<class Subtype>
+  CT_HOT static constexpr bool check() { return true; }
+};
+
+/**
+ * Checks one in Period values stored into each subtype by each thread, with a
+ * thread_local countdown per translation unit:
+ *
+ *   typedef ct::RangeConstrained<int, 0, 4095, ct::sampled<16>> pixel_t;
+ *
+ * Values that are not checked are assumed to be in range (CT_ASSUME), so an
+ * out of range value that is not detected breaks the invariant of the subtype
+ * like ct::unchecked does. Period 0 uses the period of the current thread, see
+ * set_check_period(). Constants are always checked.
+ */
+template<unsigned Period>
+struct sampled {
+  template<class Subtype>
+  CT_HOT static bool check() {
+    typename detail::check_countdown<Subtype>::type& countdown = detail::check_countdown<Subtype>::value;
+    if (CT_UNLIKELY(--countdown == 0)) {
+      countdown = Period == 0 ? detail::thread_check_period() : Period;
+      return true;
     }
-    
-  public:
-    constraint_error(T val, T first, T last) : 
-       std::out_of_range("The value " + to_string(val) + " is out of the range [" + 
-       to_string(first) + ", " + to_string(last) + "]"), 
-       _val(val), _first(first), _last(last) {}
-
-    inline const T getVal() const { return _val;}
-    inline const T getFirst() const { return _first;}
-    inline const T getLast() const { return _last;}
-  };
+    return false;
+  }
+};
+
+/// Sets the period of the ct::sampled<0> subtypes in the current thread, 1 checks every value.
+inline void set_check_period(unsigned period) {
+  detail::thread_check_period() = period == 0 ? 1 : period;
+}
+
+template<class T, T First, T Last, class Policy = always_checked>
+class RangeConstrained : public detail::range_base<T> {
+public:
+
+  /// The base type.
+  typedef T value_type;
+
+  /**
+   * Custom exception used to indicate that value was out of range.
+   *
+   * The message has the form "The value 13 is out of the range [1, 12]". All
+   * the subtypes of T throw the same class, so that each one does not add its
+   * own typeinfo and vtable; its descriptor() tells them apart.
+   */
+  typedef detail::basic_constraint_error<T> constraint_error;
   
 private:
-  T _val;
+  using detail::range_base<T>::_val;
+
+  typedef typename detail::operand<T>::type operand;
+
+  /**
+   * Kept out of line so that the hot paths inline only a compare and a branch.
+   * The location is passed in registers, so it is only materialized on the
+   * cold path.
+   */
+  [[noreturn]] CT_COLD static void raise(T val, const char* file, unsigned line, const char* function) {
+    const source_location where = { file, line, function };
+    detail::on_violation<RangeConstrained>(detail::wide_traits<T>::widen(val), CT_RETURN_ADDRESS(), where);
+    throw constraint_error(val, First, Last, descriptor(), where);
+  }
   
-  inline static const T& range_check(const T& val) {
-    if ((val < First) || (val > Last)) {
-      throw constraint_error (val, First, Last);
+  CT_HOT CT_CONSTEXPR14 static T range_check(T val CT_CHECK_WHERE_PARAM) {
+    if (!CT_IS_CONSTANT_EVALUATED() && !Policy::template check<RangeConstrained>()) {
+      detail::launder(val);
+      CT_ASSUME(!(val < First) && !(val > Last));
+      return val;
+    }
+    if (!CT_IS_CONSTANT_EVALUATED()) {
+      detail::on_check<RangeConstrained>(detail::wide_traits<T>::widen(val));
+    }
+    if (CT_UNLIKELY((val < First) || (val > Last))) {
+      raise(val, CT_RAISE_WHERE);
     }
     return val;
   }
 
 public:
   
-  RangeConstrained() : _val(First) {}
-  RangeConstrained(const T& val) : _val(range_check(val)) {}
+  CT_HOT constexpr RangeConstrained() : detail::range_base<T>(First) {}
+
+  /// Checks val, during compilation when the object is constexpr.
+  CT_HOT CT_CONSTEXPR14 RangeConstrained(const T& val CT_WHERE_PARAM) :
+    detail::range_base<T>(range_check(val CT_WHERE)) {}
+
+  /// Does not check val, see unchecked_t.
+  CT_HOT constexpr RangeConstrained(unchecked_t, const T& val) : detail::range_base<T>(val) {}
+
+  /**
+   * Checks a constant during compilation, no check is left for runtime:
+   *
+   *   month_t m = month_t::of<12>(); // OK
+   *   m = month_t::of<13>();         // Compilation error
+   */
+  template<T Value>
+  CT_HOT static constexpr RangeConstrained of() {
+    static_assert(!(Value < First) && !(Value > Last), "constant is out of the range of the subtype");
+    return RangeConstrained(unchecked, Value);
+  }
+
+#if defined(__cpp_consteval)
+  /**
+   * Same as of<Value>() for C++20, with the constant as an argument:
+   *
+   *   m = month_t::of(12);
+   */
+  static consteval RangeConstrained of(T val) {
+    if ((val < First) || (val > Last)) {
+      detail::constant_is_out_of_range();
+    }
+    return RangeConstrained(unchecked, val);
+  }
+#endif
+
+  /**
+   * Allows assignments between different range constrained instantiations.
+   *
+   * Templated only on the other base type, so converting from many subtypes of
+   * the same base type instantiates this constructor once.
+   */
+  template<class T2>
+  CT_HOT RangeConstrained(const detail::range_base<T2>& other CT_WHERE_PARAM) :
+    detail::range_base<T>(range_check(static_cast<T2>(other) CT_WHERE)) {}
   
   
-  inline static T first(void)  {
+#if defined(CT_PARANOID)
+  /**
+   * Hides the conversion of range_base to check the stored value as well. A
+   * value out of range here was not stored through a check, see
+   * subtype_range_constrained_paranoid.h.
+   */
+  CT_HOT CT_CONSTEXPR14 operator T () const {
+    if (CT_UNLIKELY((_val < First) || (_val > Last))) {
+      paranoid::corrupted(descriptor(), detail::wide_traits<T>::widen(_val), this);
+    }
+    return _val;
+  }
+#endif
+
+  CT_HOT constexpr static T first(void)  {
     return First;
   }
 
-  inline static T last(void) {
+  CT_HOT constexpr static T last(void) {
     return Last;
   }
 
@@ -109,125 +497,109 @@ public:
     return Last < First ? 0 : (size_t)Last - (size_t)First + 1;
   }
 
-  inline operator T () const {
-    return _val;
+  /// Runtime description of this subtype, its address identifies the subtype.
+  inline static const type_descriptor& descriptor(void) {
+    static const type_descriptor desc = {
+      detail::base_type_name<T>::value(), sizeof(T),
+      detail::wide_traits<T>::is_signed, detail::wide_traits<T>::is_character,
+      detail::wide_traits<T>::widen(First), detail::wide_traits<T>::widen(Last)
+    };
+    return desc;
   }
- 
-  /// Allows assignments between different range constrained instantiations.
-  template<class T2, T2 F, T2 L>
-  inline operator RangeConstrained<T2, F, L> () const {
-    return RangeConstrained<T2, F, L>(_val);
+
+  /**
+   * Reports val as a failed check of this subtype, whatever its check policy:
+   * the enabled instrumentation sees the violation, then constraint_error is
+   * thrown. For code that checks the values itself, like ct::view_as().
+   */
+  [[noreturn]] static void report_violation(T val) {
+    raise(val, nullptr, 0, nullptr);
   }
 
-  inline RangeConstrained& operator += (const T& other) {
-    //if(std::numeric_limits<T>::max() - other > _val)
-    //  throw std::out_of_range ("Out of the base type range");
+  /*
+   * The compound operators compute in the promoted type and convert back to T
+   * before checking, exactly like "T temp = _val; temp op= other;" would.
+   * Their operand converts implicitly to T, see detail::operand.
+   */
 
-    T temp = _val;
-    temp += other;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator += (operand other) {
+    _val = range_check(_val + detail::value_of(other) CT_WHERE_OF(other));
     return *this;
   }
 
-  inline RangeConstrained& operator -= (const T& other) {
-    T temp = _val;
-    temp -= other;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator -= (operand other) {
+    _val = range_check(_val - detail::value_of(other) CT_WHERE_OF(other));
     return *this;
   }
 
-  inline RangeConstrained& operator *= (const T& other) {
-    T temp = _val;
-    temp *= other;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator *= (operand other) {
+    _val = range_check(_val * detail::value_of(other) CT_WHERE_OF(other));
     return *this;
-   }
+  }
 
-   inline RangeConstrained& operator /= (const T& other) {
-    T temp = _val;
-    temp /= other;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator /= (operand other) {
+    _val = range_check(_val / detail::value_of(other) CT_WHERE_OF(other));
     return *this;
-   }
+  }
 
-  inline RangeConstrained& operator %= (const T& other) {
-    T temp = _val;
-    temp %= other;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator %= (operand other) {
+    _val = range_check(_val % detail::value_of(other) CT_WHERE_OF(other));
     return *this;
   }
 
-  inline RangeConstrained& operator &= (const T& other) {
-    T temp = _val;
-    temp &= other;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator &= (operand other) {
+    _val = range_check(_val & detail::value_of(other) CT_WHERE_OF(other));
     return *this;
   }
 
-  inline RangeConstrained& operator |= (const T& other) {
-    T temp = _val;
-    temp |= other;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator |= (operand other) {
+    _val = range_check(_val | detail::value_of(other) CT_WHERE_OF(other));
     return *this;
   }
 
-  inline RangeConstrained& operator ^= (const T& other) {
-    T temp = _val;
-    temp ^= other;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator ^= (operand other) {
+    _val = range_check(_val ^ detail::value_of(other) CT_WHERE_OF(other));
     return *this;
   }
 
-  inline RangeConstrained& operator <<= (const T& other) {
-    T temp = _val;
-    temp <<= other;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator <<= (operand other) {
+    _val = range_check(_val << detail::value_of(other) CT_WHERE_OF(other));
     return *this;
   }
 
-  inline RangeConstrained& operator >>= (const T& other) {
-    T temp = _val;
-    temp >>= other;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator >>= (operand other) {
+    _val = range_check(_val >> detail::value_of(other) CT_WHERE_OF(other));
     return *this;
   }
 
   /**
    * Prefix, return reference of this
    */
-  inline RangeConstrained& operator ++() {
-    T temp = _val;
-    temp++;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator ++() {
+    _val = range_check(_val + 1);
     return *this;
   }
 
   /**
    * Prefix, return reference of this
    */
-  inline RangeConstrained& operator --() {
-    T temp = _val;
-    temp--;
-    _val = range_check(temp);
+  CT_HOT RangeConstrained& operator --() {
+    _val = range_check(_val - 1);
     return *this;
   }
 
   /**
    * Postfix, return old value by value
    */
-  inline const RangeConstrained operator ++(int) {
+  CT_HOT const RangeConstrained operator ++(int) {
     RangeConstrained old(*this);
-    T temp = _val;
-    ++temp;
-    _val = range_check(temp);
+    ++*this;
     return old;
   }
 
-  inline const RangeConstrained operator --(int) {
+  CT_HOT const RangeConstrained operator --(int) {
     RangeConstrained old(*this);
-    T temp = _val;
-    --temp;
-    _val = range_check(temp);
+    --*this;
     return old;
   }
 };
@@ -236,4 +608,23 @@ public:
 
 namespace ct = ConstrainedTypes;
 
+#if defined(__cpp_consteval)
+/**
+ * Defines a user-defined literal for a subtype whose value is checked during
+ * compilation. Use at namespace scope:
+ *
+ *   CT_DEFINE_LITERAL(month_t, _month)
+ *   month_t m = 12_month; // OK
+ *   m = 13_month;         // Compilation error
+ */
+#define CT_DEFINE_LITERAL(subtype, suffix)                                              \
+  consteval subtype operator"" suffix(unsigned long long val) {                         \
+    if (val > (unsigned long long)std::numeric_limits<                                  \
+               ct::detail::wide_traits<decltype(subtype::first())>::integral>::max()) { \
+      ct::detail::constant_is_out_of_range();                                           \
+    }                                                                                   \
+    return subtype::of((decltype(subtype::first()))val);                                \
+  }
+#endif
+
 #endif
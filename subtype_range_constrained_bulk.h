@@ -0,0 +1,2264 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Operations on whole buffers of a subtype.
+ *
+ * The range checks of the bulk operations are made on many elements at once,
+ * with SSE4.2, AVX2 or AVX-512 on x86 processors that have them, and the
+ * results are stored into the subtype without a check per element:
+ *
+ *   #include "subtype_range_constrained_bulk.h"
+ *
+ *   size_t count = ct::filter<altitude_t>(raw, n, altitudes);
+ *
+ * Every function takes a pointer and a count. With C++20 each one also has a
+ * std::span overload that returns the span of the results.
+ *
+ * The SIMD kernels are compiled with the target attribute, so the program
+ * itself does not have to be built for these instruction sets. The level is
+ * detected once, when the first bulk operation runs. It can be lowered with
+ * CT_SIMD=scalar, sse4.2, avx2 or avx512 in the environment, or with
+ * ct::set_simd_level(). Other values of CT_SIMD are reported and ignored.
+ */
+
+
+#ifndef SUBTYPE_RANGE_CONSTRAINED_BULK_H
+#define SUBTYPE_RANGE_CONSTRAINED_BULK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <type_traits>
+#include "subtype_range_constrained.h"
+
+#if defined(__cplusplus) && __cplusplus >= 202002L && defined(__has_include)
+#  if __has_include(<span>)
+#    include <span>
+#  endif
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  include <immintrin.h>
+#  define CT_BULK_X86 1
+#  define CT_TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#  define CT_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#  define CT_TARGET_AVX512 __attribute__((target("avx512f,avx512vl,avx512bw,popcnt")))
+#else
+#  define CT_BULK_X86 0
+#endif
+
+/// Kernels written with the vector extension of GCC and Clang, see CT_ARITHMETIC_KERNEL.
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 9)
+#  define CT_BULK_VECTORS 1
+#else
+#  define CT_BULK_VECTORS 0
+#endif
+
+namespace ConstrainedTypes {
+
+/// Instruction sets of the bulk kernels, from the slowest to the fastest.
+enum simd_level {
+  SIMD_SCALAR,
+  SIMD_SSE42,
+  SIMD_AVX2,
+  SIMD_AVX512
+};
+
+namespace detail {
+
+/// The best level this processor supports, detected once.
+inline simd_level detected_simd_level() {
+#if CT_BULK_X86
+  static const simd_level level =
+      __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+      __builtin_cpu_supports("avx512bw") ? SIMD_AVX512 :
+      __builtin_cpu_supports("avx2") ? SIMD_AVX2 :
+      __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt") ? SIMD_SSE42 : SIMD_SCALAR;
+  return level;
+#else
+  return SIMD_SCALAR;
+#endif
+}
+
+inline const char* const* simd_level_names() {
+  static const char* const names[] = { "scalar", "sse4.2", "avx2", "avx512" };
+  return names;
+}
+
+/**
+ * Sets level to the one named by value, as CT_SIMD spells them: "scalar",
+ * "sse4.2", "avx2" or "avx512". False for any other value and for a level
+ * above detected.
+ */
+inline bool parse_simd_level(const char* value, simd_level detected, simd_level& level) {
+  for (int named = SIMD_SCALAR; named <= SIMD_AVX512; ++named) {
+    if (std::strcmp(value, simd_level_names()[named]) == 0) {
+      level = (simd_level)named;
+      return named <= detected;
+    }
+  }
+  return false;
+}
+
+/**
+ * The level named by CT_SIMD in the environment, else the detected one. A
+ * value that parse_simd_level() rejects is reported on the standard error.
+ */
+inline simd_level initial_simd_level() {
+  const simd_level detected = detected_simd_level();
+  const char* value = std::getenv("CT_SIMD");
+  simd_level level = detected;
+  if (value == nullptr || *value == '\0' || parse_simd_level(value, detected, level)) {
+    return level;
+  }
+  std::fprintf(stderr, "CT_SIMD=%s ignored: takes scalar, sse4.2, avx2 or avx512 up to %s on this processor\n",
+               value, simd_level_names()[detected]);
+  return detected;
+}
+
+inline std::atomic<simd_level>& selected_simd_level() {
+  static std::atomic<simd_level> level(initial_simd_level());
+  return level;
+}
+
+}
+
+/// Name of level as CT_SIMD takes it: "scalar", "sse4.2", "avx2" or "avx512".
+inline const char* simd_level_name(simd_level level) {
+  return detail::simd_level_names()[level];
+}
+
+/**
+ * The level the bulk operations run at. It is chosen when the first one runs:
+ * the best level of the processor, or a lower one set with CT_SIMD=scalar,
+ * sse4.2, avx2 or avx512 in the environment.
+ */
+inline simd_level get_simd_level() {
+  return detail::selected_simd_level().load(std::memory_order_relaxed);
+}
+
+/**
+ * Makes the bulk operations run at level, for benchmarks and tests, and
+ * returns the previous level. A level above the best one of the processor is
+ * lowered to it, since its instructions would fault.
+ */
+inline simd_level set_simd_level(simd_level level) {
+  const simd_level detected = detail::detected_simd_level();
+  return detail::selected_simd_level().exchange(level < detected ? level : detected);
+}
+
+namespace detail {
+
+/**
+ * The bulk operations write the base type into arrays of the subtype, which
+ * is only valid because a subtype is stored exactly like its base type.
+ */
+template<class RC>
+struct bulk_traits {
+  typedef typename RC::value_type T;
+  typedef typename integral_of<T>::type integral;
+
+  static_assert(std::is_standard_layout<RC>::value, "a subtype must be standard layout");
+  static_assert(sizeof(RC) == sizeof(T), "a subtype must have the size of its base type");
+  static_assert(alignof(RC) == alignof(T), "a subtype must have the alignment of its base type");
+
+  static const bool is_signed = std::is_signed<integral>::value;
+
+  /// Whether the SIMD kernels of this lane width apply, bool and characters are left to the scalar loop.
+  static const bool simd32 = sizeof(integral) == 4 && !std::is_same<integral, wchar_t>::value;
+  static const bool simd64 = sizeof(integral) == 8;
+
+  static bool in_range(T v) {
+    return !(v < RC::first()) && !(v > RC::last());
+  }
+
+  static constexpr integral lo() { return (integral)RC::first(); }
+  static constexpr integral hi() { return (integral)RC::last(); }
+
+  /// Fixed width integer of the same size and signedness, the element of the vector kernels.
+  typedef typename std::conditional<sizeof(integral) == 1, int8_t,
+          typename std::conditional<sizeof(integral) == 2, int16_t,
+          typename std::conditional<sizeof(integral) == 4, int32_t, int64_t>::type>::type>::type signed_lane;
+  typedef typename std::conditional<is_signed, signed_lane,
+                                    typename std::make_unsigned<signed_lane>::type>::type lane;
+};
+
+/// Stores every element and advances past the ones in range, without a branch.
+template<class RC>
+size_t filter_scalar(const typename RC::value_type* src, size_t n, typename RC::value_type* dst) {
+  size_t k = 0;
+  for (size_t i = 0; i < n; ++i) {
+    typename RC::value_type v = src[i];
+    dst[k] = v;
+    k += bulk_traits<RC>::in_range(v) ? 1 : 0;
+  }
+  return k;
+}
+
+/// Same as filter_scalar, with indices numbered from base.
+template<class RC>
+size_t select_scalar(const typename RC::value_type* src, size_t n, uint32_t* indices, size_t base) {
+  size_t k = 0;
+  for (size_t i = 0; i < n; ++i) {
+    indices[k] = (uint32_t)(base + i);
+    k += bulk_traits<RC>::in_range(src[i]) ? 1 : 0;
+  }
+  return k;
+}
+
+#if CT_BULK_X86
+
+/**
+ * Permutations that move the lanes selected by an 8 bit mask to the front,
+ * for the AVX2 kernels that have no compress instruction. Entry m holds the
+ * indices of the 32 bit lanes; lanes64 holds them for 64 bit lanes, as pairs
+ * of 32 bit lanes. bytes32 holds the byte shuffles of the SSE4.2 kernels for
+ * 4 bit masks of 32 bit lanes.
+ */
+struct compress_tables {
+  uint64_t lanes32[256];
+  uint64_t lanes64[16];
+  uint8_t bytes32[16][16];
+
+  compress_tables() {
+    for (unsigned m = 0; m < 256; ++m) {
+      uint64_t entry = 0;
+      unsigned k = 0;
+      for (unsigned lane = 0; lane < 8; ++lane) {
+        if (m & (1u << lane)) {
+          entry |= (uint64_t)lane << (8 * k++);
+        }
+      }
+      lanes32[m] = entry;
+    }
+    for (unsigned m = 0; m < 16; ++m) {
+      uint64_t entry = 0;
+      unsigned k = 0;
+      for (unsigned lane = 0; lane < 4; ++lane) {
+        if (m & (1u << lane)) {
+          entry |= (uint64_t)(2 * lane) << (8 * k++);
+          entry |= (uint64_t)(2 * lane + 1) << (8 * k++);
+        }
+      }
+      lanes64[m] = entry;
+    }
+    for (unsigned m = 0; m < 16; ++m) {
+      unsigned k = 0;
+      for (unsigned lane = 0; lane < 4; ++lane) {
+        for (unsigned byte = 0; (m & (1u << lane)) && byte < 4; ++byte) {
+          bytes32[m][k++] = (uint8_t)(4 * lane + byte);
+        }
+      }
+      while (k < 16) {
+        bytes32[m][k++] = 0x80;
+      }
+    }
+  }
+
+  static const compress_tables& instance() {
+    static const compress_tables tables;
+    return tables;
+  }
+};
+
+/// Same as the AVX2 helpers below, for the 128 bit vectors of the SSE4.2 kernels.
+CT_TARGET_SSE42 inline __m128i bias32(__m128i v, bool is_signed) {
+  return is_signed ? v : _mm_xor_si128(v, _mm_set1_epi32((int)0x80000000u));
+}
+
+CT_TARGET_SSE42 inline __m128i bias64(__m128i v, bool is_signed) {
+  return is_signed ? v : _mm_xor_si128(v, _mm_set1_epi64x((long long)0x8000000000000000ull));
+}
+
+CT_TARGET_SSE42 inline unsigned in_range_mask32(__m128i v, __m128i lo, __m128i hi) {
+  __m128i out = _mm_or_si128(_mm_cmpgt_epi32(lo, v), _mm_cmpgt_epi32(v, hi));
+  return ~(unsigned)_mm_movemask_ps(_mm_castsi128_ps(out)) & 0xf;
+}
+
+CT_TARGET_SSE42 inline unsigned in_range_mask64(__m128i v, __m128i lo, __m128i hi) {
+  __m128i out = _mm_or_si128(_mm_cmpgt_epi64(lo, v), _mm_cmpgt_epi64(v, hi));
+  return ~(unsigned)_mm_movemask_pd(_mm_castsi128_pd(out)) & 0x3;
+}
+
+/// Shuffle that moves the 32 bit lanes of mask m to the front, 64 bit lanes are expanded to pairs.
+CT_TARGET_SSE42 inline __m128i shuffle32(unsigned m) {
+  return _mm_loadu_si128((const __m128i*)compress_tables::instance().bytes32[m]);
+}
+
+CT_TARGET_SSE42 inline __m128i shuffle64(unsigned m) {
+  return shuffle32((m & 1) * 0x3 | (m & 2) * 0x6);
+}
+
+CT_TARGET_SSE42 inline size_t filter32_sse42(const uint32_t* src, size_t n, uint32_t* dst,
+                                            uint32_t lo, uint32_t hi, bool is_signed) {
+  const __m128i vlo = bias32(_mm_set1_epi32((int)lo), is_signed);
+  const __m128i vhi = bias32(_mm_set1_epi32((int)hi), is_signed);
+  size_t i = 0, k = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    unsigned m = in_range_mask32(bias32(v, is_signed), vlo, vhi);
+    _mm_storeu_si128((__m128i*)(dst + k), _mm_shuffle_epi8(v, shuffle32(m)));
+    k += (size_t)_mm_popcnt_u32(m);
+  }
+  return k + i;
+}
+
+CT_TARGET_SSE42 inline size_t filter64_sse42(const uint64_t* src, size_t n, uint64_t* dst,
+                                            uint64_t lo, uint64_t hi, bool is_signed) {
+  const __m128i vlo = bias64(_mm_set1_epi64x((long long)lo), is_signed);
+  const __m128i vhi = bias64(_mm_set1_epi64x((long long)hi), is_signed);
+  size_t i = 0, k = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    unsigned m = in_range_mask64(bias64(v, is_signed), vlo, vhi);
+    _mm_storeu_si128((__m128i*)(dst + k), _mm_shuffle_epi8(v, shuffle64(m)));
+    k += (size_t)_mm_popcnt_u32(m);
+  }
+  return k + i;
+}
+
+CT_TARGET_SSE42 inline size_t select32_sse42(const uint32_t* src, size_t n, uint32_t* indices,
+                                            uint32_t lo, uint32_t hi, bool is_signed) {
+  const __m128i vlo = bias32(_mm_set1_epi32((int)lo), is_signed);
+  const __m128i vhi = bias32(_mm_set1_epi32((int)hi), is_signed);
+  __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+  size_t i = 0, k = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    unsigned m = in_range_mask32(bias32(v, is_signed), vlo, vhi);
+    _mm_storeu_si128((__m128i*)(indices + k), _mm_shuffle_epi8(index, shuffle32(m)));
+    k += (size_t)_mm_popcnt_u32(m);
+    index = _mm_add_epi32(index, _mm_set1_epi32(4));
+  }
+  return k + i;
+}
+
+CT_TARGET_SSE42 inline size_t select64_sse42(const uint64_t* src, size_t n, uint32_t* indices,
+                                            uint64_t lo, uint64_t hi, bool is_signed) {
+  const __m128i vlo = bias64(_mm_set1_epi64x((long long)lo), is_signed);
+  const __m128i vhi = bias64(_mm_set1_epi64x((long long)hi), is_signed);
+  __m128i index = _mm_setr_epi32(0, 1, 0, 0);
+  size_t i = 0, k = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    unsigned m = in_range_mask64(bias64(v, is_signed), vlo, vhi);
+    _mm_storel_epi64((__m128i*)(indices + k), _mm_shuffle_epi8(index, shuffle32(m)));
+    k += (size_t)_mm_popcnt_u32(m);
+    index = _mm_add_epi32(index, _mm_set1_epi32(2));
+  }
+  return k + i;
+}
+
+/// Flips the sign bit, so that a signed compare orders unsigned lanes.
+CT_TARGET_AVX2 inline __m256i bias32(__m256i v, bool is_signed) {
+  return is_signed ? v : _mm256_xor_si256(v, _mm256_set1_epi32((int)0x80000000u));
+}
+
+CT_TARGET_AVX2 inline __m256i bias64(__m256i v, bool is_signed) {
+  return is_signed ? v : _mm256_xor_si256(v, _mm256_set1_epi64x((long long)0x8000000000000000ull));
+}
+
+/// Mask of the 32 bit lanes of v (biased) within [lo, hi] (biased).
+CT_TARGET_AVX2 inline unsigned in_range_mask32(__m256i v, __m256i lo, __m256i hi) {
+  __m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(v, hi));
+  return ~(unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xff;
+}
+
+CT_TARGET_AVX2 inline unsigned in_range_mask64(__m256i v, __m256i lo, __m256i hi) {
+  __m256i out = _mm256_or_si256(_mm256_cmpgt_epi64(lo, v), _mm256_cmpgt_epi64(v, hi));
+  return ~(unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(out)) & 0xf;
+}
+
+CT_TARGET_AVX2 inline __m256i permutation(uint64_t entry) {
+  return _mm256_cvtepu8_epi32(_mm_cvtsi64_si128((long long)entry));
+}
+
+/*
+ * The main loops store whole vectors at dst + k. Since k <= i, the store ends
+ * before dst + i + lanes <= dst + n.
+ */
+
+CT_TARGET_AVX2 inline size_t filter32_avx2(const uint32_t* src, size_t n, uint32_t* dst,
+                                          uint32_t lo, uint32_t hi, bool is_signed) {
+  const compress_tables& tables = compress_tables::instance();
+  const __m256i vlo = bias32(_mm256_set1_epi32((int)lo), is_signed);
+  const __m256i vhi = bias32(_mm256_set1_epi32((int)hi), is_signed);
+  size_t i = 0, k = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+    unsigned m = in_range_mask32(bias32(v, is_signed), vlo, vhi);
+    _mm256_storeu_si256((__m256i*)(dst + k), _mm256_permutevar8x32_epi32(v, permutation(tables.lanes32[m])));
+    k += (size_t)_mm_popcnt_u32(m);
+  }
+  return k + i;
+}
+
+CT_TARGET_AVX2 inline size_t filter64_avx2(const uint64_t* src, size_t n, uint64_t* dst,
+                                          uint64_t lo, uint64_t hi, bool is_signed) {
+  const compress_tables& tables = compress_tables::instance();
+  const __m256i vlo = bias64(_mm256_set1_epi64x((long long)lo), is_signed);
+  const __m256i vhi = bias64(_mm256_set1_epi64x((long long)hi), is_signed);
+  size_t i = 0, k = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+    unsigned m = in_range_mask64(bias64(v, is_signed), vlo, vhi);
+    _mm256_storeu_si256((__m256i*)(dst + k), _mm256_permutevar8x32_epi32(v, permutation(tables.lanes64[m])));
+    k += (size_t)_mm_popcnt_u32(m);
+  }
+  return k + i;
+}
+
+CT_TARGET_AVX2 inline size_t select32_avx2(const uint32_t* src, size_t n, uint32_t* indices,
+                                          uint32_t lo, uint32_t hi, bool is_signed) {
+  const compress_tables& tables = compress_tables::instance();
+  const __m256i vlo = bias32(_mm256_set1_epi32((int)lo), is_signed);
+  const __m256i vhi = bias32(_mm256_set1_epi32((int)hi), is_signed);
+  __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  size_t i = 0, k = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+    unsigned m = in_range_mask32(bias32(v, is_signed), vlo, vhi);
+    _mm256_storeu_si256((__m256i*)(indices + k), _mm256_permutevar8x32_epi32(index, permutation(tables.lanes32[m])));
+    k += (size_t)_mm_popcnt_u32(m);
+    index = _mm256_add_epi32(index, _mm256_set1_epi32(8));
+  }
+  return k + i;
+}
+
+CT_TARGET_AVX2 inline size_t select64_avx2(const uint64_t* src, size_t n, uint32_t* indices,
+                                          uint64_t lo, uint64_t hi, bool is_signed) {
+  const compress_tables& tables = compress_tables::instance();
+  const __m256i vlo = bias64(_mm256_set1_epi64x((long long)lo), is_signed);
+  const __m256i vhi = bias64(_mm256_set1_epi64x((long long)hi), is_signed);
+  __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 0, 0, 0, 0);
+  size_t i = 0, k = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+    unsigned m = in_range_mask64(bias64(v, is_signed), vlo, vhi);
+    __m256i selected = _mm256_permutevar8x32_epi32(index, permutation(tables.lanes32[m]));
+    _mm_storeu_si128((__m128i*)(indices + k), _mm256_castsi256_si128(selected));
+    k += (size_t)_mm_popcnt_u32(m);
+    index = _mm256_add_epi32(index, _mm256_set1_epi32(4));
+  }
+  return k + i;
+}
+
+CT_TARGET_AVX512 inline __mmask16 in_range_mask32(__m512i v, __m512i lo, __m512i hi, bool is_signed) {
+  return is_signed ? _mm512_mask_cmple_epi32_mask(_mm512_cmpge_epi32_mask(v, lo), v, hi)
+                   : _mm512_mask_cmple_epu32_mask(_mm512_cmpge_epu32_mask(v, lo), v, hi);
+}
+
+CT_TARGET_AVX512 inline __mmask8 in_range_mask64(__m512i v, __m512i lo, __m512i hi, bool is_signed) {
+  return is_signed ? _mm512_mask_cmple_epi64_mask(_mm512_cmpge_epi64_mask(v, lo), v, hi)
+                   : _mm512_mask_cmple_epu64_mask(_mm512_cmpge_epu64_mask(v, lo), v, hi);
+}
+
+/// The last partial vector is read with a masked load, which does not fault past the end.
+CT_TARGET_AVX512 inline size_t filter32_avx512(const uint32_t* src, size_t n, uint32_t* dst,
+                                              uint32_t lo, uint32_t hi, bool is_signed) {
+  const __m512i vlo = _mm512_set1_epi32((int)lo);
+  const __m512i vhi = _mm512_set1_epi32((int)hi);
+  size_t i = 0, k = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512i v = _mm512_loadu_si512((const void*)(src + i));
+    __mmask16 m = in_range_mask32(v, vlo, vhi, is_signed);
+    _mm512_storeu_si512((void*)(dst + k), _mm512_maskz_compress_epi32(m, v));
+    k += (size_t)_mm_popcnt_u32(m);
+  }
+  if (i < n) {
+    __mmask16 tail = (__mmask16)((1u << (n - i)) - 1);
+    __m512i v = _mm512_maskz_loadu_epi32(tail, src + i);
+    __mmask16 m = in_range_mask32(v, vlo, vhi, is_signed) & tail;
+    _mm512_mask_compressstoreu_epi32(dst + k, m, v);
+    k += (size_t)_mm_popcnt_u32(m);
+  }
+  return k;
+}
+
+CT_TARGET_AVX512 inline size_t filter64_avx512(const uint64_t* src, size_t n, uint64_t* dst,
+                                              uint64_t lo, uint64_t hi, bool is_signed) {
+  const __m512i vlo = _mm512_set1_epi64((long long)lo);
+  const __m512i vhi = _mm512_set1_epi64((long long)hi);
+  size_t i = 0, k = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i v = _mm512_loadu_si512((const void*)(src + i));
+    __mmask8 m = in_range_mask64(v, vlo, vhi, is_signed);
+    _mm512_storeu_si512((void*)(dst + k), _mm512_maskz_compress_epi64(m, v));
+    k += (size_t)_mm_popcnt_u32(m);
+  }
+  if (i < n) {
+    __mmask8 tail = (__mmask8)((1u << (n - i)) - 1);
+    __m512i v = _mm512_maskz_loadu_epi64(tail, src + i);
+    __mmask8 m = in_range_mask64(v, vlo, vhi, is_signed) & tail;
+    _mm512_mask_compressstoreu_epi64(dst + k, m, v);
+    k += (size_t)_mm_popcnt_u32(m);
+  }
+  return k;
+}
+
+CT_TARGET_AVX512 inline size_t select32_avx512(const uint32_t* src, size_t n, uint32_t* indices,
+                                              uint32_t lo, uint32_t hi, bool is_signed) {
+  const __m512i vlo = _mm512_set1_epi32((int)lo);
+  const __m512i vhi = _mm512_set1_epi32((int)hi);
+  __m512i index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  size_t i = 0, k = 0;
+  for (; i < n; i += 16) {
+    __mmask16 tail = n - i >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (n - i)) - 1);
+    __m512i v = _mm512_maskz_loadu_epi32(tail, src + i);
+    __mmask16 m = in_range_mask32(v, vlo, vhi, is_signed) & tail;
+    _mm512_mask_compressstoreu_epi32(indices + k, m, index);
+    k += (size_t)_mm_popcnt_u32(m);
+    index = _mm512_add_epi32(index, _mm512_set1_epi32(16));
+  }
+  return k;
+}
+
+CT_TARGET_AVX512 inline size_t select64_avx512(const uint64_t* src, size_t n, uint32_t* indices,
+                                              uint64_t lo, uint64_t hi, bool is_signed) {
+  const __m512i vlo = _mm512_set1_epi64((long long)lo);
+  const __m512i vhi = _mm512_set1_epi64((long long)hi);
+  __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  size_t i = 0, k = 0;
+  for (; i < n; i += 8) {
+    __mmask8 tail = n - i >= 8 ? (__mmask8)0xff : (__mmask8)((1u << (n - i)) - 1);
+    __m512i v = _mm512_maskz_loadu_epi64(tail, src + i);
+    __mmask8 m = in_range_mask64(v, vlo, vhi, is_signed) & tail;
+    _mm256_mask_compressstoreu_epi32(indices + k, m, index);
+    k += (size_t)_mm_popcnt_u32(m);
+    index = _mm256_add_epi32(index, _mm256_set1_epi32(8));
+  }
+  return k;
+}
+
+/**
+ * Converting kernels, from 32 bit lanes to lanes of Size bytes. They stop at
+ * the first vector that holds a value out of [lo, hi] and return its index,
+ * the scalar loop finishes from there. The values that are stored are in
+ * range, so the saturating packs never saturate.
+ */
+template<unsigned Size, bool Signed>
+CT_TARGET_AVX2 inline size_t convert32_avx2(const uint32_t* src, size_t n, void* dst,
+                                           uint32_t lo, uint32_t hi, bool is_signed) {
+  const __m256i vlo = bias32(_mm256_set1_epi32((int)lo), is_signed);
+  const __m256i vhi = bias32(_mm256_set1_epi32((int)hi), is_signed);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+    if (in_range_mask32(bias32(v, is_signed), vlo, vhi) != 0xff) {
+      break;
+    }
+    if (Size == 4) {
+      _mm256_storeu_si256((__m256i*)((uint32_t*)dst + i), v);
+      continue;
+    }
+    __m128i low = _mm256_castsi256_si128(v), high = _mm256_extracti128_si256(v, 1);
+    if (Size == 2) {
+      __m128i packed = Signed ? _mm_packs_epi32(low, high) : _mm_packus_epi32(low, high);
+      _mm_storeu_si128((__m128i*)((uint16_t*)dst + i), packed);
+    } else {
+      __m128i words = _mm_packs_epi32(low, high);
+      __m128i packed = Signed ? _mm_packs_epi16(words, words) : _mm_packus_epi16(words, words);
+      _mm_storel_epi64((__m128i*)((uint8_t*)dst + i), packed);
+    }
+  }
+  return i;
+}
+
+template<unsigned Size, bool Signed>
+CT_TARGET_SSE42 inline size_t convert32_sse42(const uint32_t* src, size_t n, void* dst,
+                                             uint32_t lo, uint32_t hi, bool is_signed) {
+  const __m128i vlo = bias32(_mm_set1_epi32((int)lo), is_signed);
+  const __m128i vhi = bias32(_mm_set1_epi32((int)hi), is_signed);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    if (in_range_mask32(bias32(v, is_signed), vlo, vhi) != 0xf) {
+      break;
+    }
+    if (Size == 4) {
+      _mm_storeu_si128((__m128i*)((uint32_t*)dst + i), v);
+    } else if (Size == 2) {
+      __m128i packed = Signed ? _mm_packs_epi32(v, v) : _mm_packus_epi32(v, v);
+      _mm_storel_epi64((__m128i*)((uint16_t*)dst + i), packed);
+    } else {
+      __m128i words = _mm_packs_epi32(v, v);
+      __m128i packed = Signed ? _mm_packs_epi16(words, words) : _mm_packus_epi16(words, words);
+      const int bytes = _mm_cvtsi128_si32(packed);
+      std::memcpy((uint8_t*)dst + i, &bytes, sizeof(bytes));
+    }
+  }
+  return i;
+}
+
+template<unsigned Size, bool Signed>
+CT_TARGET_AVX512 inline size_t convert32_avx512(const uint32_t* src, size_t n, void* dst,
+                                               uint32_t lo, uint32_t hi, bool is_signed) {
+  const __m512i vlo = _mm512_set1_epi32((int)lo);
+  const __m512i vhi = _mm512_set1_epi32((int)hi);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512i v = _mm512_loadu_si512((const void*)(src + i));
+    if (in_range_mask32(v, vlo, vhi, is_signed) != 0xffff) {
+      break;
+    }
+    if (Size == 4) {
+      _mm512_storeu_si512((void*)((uint32_t*)dst + i), v);
+    } else if (Size == 2 && Signed) {
+      _mm512_mask_cvtsepi32_storeu_epi16((uint16_t*)dst + i, 0xffff, v);
+    } else if (Size == 2) {
+      _mm512_mask_cvtusepi32_storeu_epi16((uint16_t*)dst + i, 0xffff, v);
+    } else if (Signed) {
+      _mm512_mask_cvtsepi32_storeu_epi8((uint8_t*)dst + i, 0xffff, v);
+    } else {
+      _mm512_mask_cvtusepi32_storeu_epi8((uint8_t*)dst + i, 0xffff, v);
+    }
+  }
+  return i;
+}
+
+#endif
+
+/**
+ * Copies the elements of src that are in the range of RC to dst, in order, and
+ * returns their number. The SSE4.2 and AVX2 kernels only handle whole vectors
+ * and return the number of elements they consumed added to the number they
+ * kept, so the remainder is finished by the scalar loop.
+ */
+template<class RC>
+size_t filter_at(simd_level level, const typename RC::value_type* src, size_t n, RC* dst) {
+  typedef bulk_traits<RC> traits;
+  typedef typename traits::T T;
+  T* out = reinterpret_cast<T*>(dst);
+#if CT_BULK_X86
+  if (traits::simd32 && level >= SIMD_SSE42) {
+    const uint32_t* in32 = reinterpret_cast<const uint32_t*>(src);
+    uint32_t* out32 = reinterpret_cast<uint32_t*>(out);
+    const uint32_t lo = (uint32_t)traits::lo(), hi = (uint32_t)traits::hi();
+    if (level >= SIMD_AVX512) {
+      return filter32_avx512(in32, n, out32, lo, hi, traits::is_signed);
+    }
+    const bool avx2 = level >= SIMD_AVX2;
+    size_t done = avx2 ? filter32_avx2(in32, n, out32, lo, hi, traits::is_signed) : filter32_sse42(in32, n, out32, lo, hi, traits::is_signed);
+    size_t i = n - n % (avx2 ? 8 : 4), k = done - i;
+    return k + filter_scalar<RC>(src + i, n - i, out + k);
+  }
+  if (traits::simd64 && level >= SIMD_SSE42) {
+    const uint64_t* in64 = reinterpret_cast<const uint64_t*>(src);
+    uint64_t* out64 = reinterpret_cast<uint64_t*>(out);
+    const uint64_t lo = (uint64_t)traits::lo(), hi = (uint64_t)traits::hi();
+    if (level >= SIMD_AVX512) {
+      return filter64_avx512(in64, n, out64, lo, hi, traits::is_signed);
+    }
+    const bool avx2 = level >= SIMD_AVX2;
+    size_t done = avx2 ? filter64_avx2(in64, n, out64, lo, hi, traits::is_signed) : filter64_sse42(in64, n, out64, lo, hi, traits::is_signed);
+    size_t i = n - n % (avx2 ? 4 : 2), k = done - i;
+    return k + filter_scalar<RC>(src + i, n - i, out + k);
+  }
+#endif
+  (void)level;
+  return filter_scalar<RC>(src, n, out);
+}
+
+template<class RC>
+size_t select_indices_at(simd_level level, const typename RC::value_type* src, size_t n, uint32_t* indices) {
+#if CT_BULK_X86
+  typedef bulk_traits<RC> traits;
+  if (traits::simd32 && level >= SIMD_SSE42) {
+    const uint32_t* in32 = reinterpret_cast<const uint32_t*>(src);
+    const uint32_t lo = (uint32_t)traits::lo(), hi = (uint32_t)traits::hi();
+    if (level >= SIMD_AVX512) {
+      return select32_avx512(in32, n, indices, lo, hi, traits::is_signed);
+    }
+    const bool avx2 = level >= SIMD_AVX2;
+    size_t done = avx2 ? select32_avx2(in32, n, indices, lo, hi, traits::is_signed) : select32_sse42(in32, n, indices, lo, hi, traits::is_signed);
+    size_t i = n - n % (avx2 ? 8 : 4), k = done - i;
+    return k + select_scalar<RC>(src + i, n - i, indices + k, i);
+  }
+  if (traits::simd64 && level >= SIMD_SSE42) {
+    const uint64_t* in64 = reinterpret_cast<const uint64_t*>(src);
+    const uint64_t lo = (uint64_t)traits::lo(), hi = (uint64_t)traits::hi();
+    if (level >= SIMD_AVX512) {
+      return select64_avx512(in64, n, indices, lo, hi, traits::is_signed);
+    }
+    const bool avx2 = level >= SIMD_AVX2;
+    size_t done = avx2 ? select64_avx2(in64, n, indices, lo, hi, traits::is_signed) : select64_sse42(in64, n, indices, lo, hi, traits::is_signed);
+    size_t i = n - n % (avx2 ? 4 : 2), k = done - i;
+    return k + select_scalar<RC>(src + i, n - i, indices + k, i);
+  }
+#endif
+  (void)level;
+  return select_scalar<RC>(src, n, indices, 0);
+}
+
+}
+
+/**
+ * Copies the elements of src[0, n) that are in the range of RC to dst, keeping
+ * their order, and returns their number. dst must have room for n elements,
+ * the elements after the returned count are unspecified.
+ */
+template<class RC>
+size_t filter(const typename RC::value_type* src, size_t n, RC* dst) {
+  return detail::filter_at<RC>(get_simd_level(), src, n, dst);
+}
+
+/**
+ * Writes the indices of the elements of src[0, n) that are in the range of RC
+ * to indices and returns their number. indices must have room for n elements,
+ * and n must be below 2^32.
+ */
+template<class RC>
+size_t select_indices(const typename RC::value_type* src, size_t n, uint32_t* indices) {
+  return detail::select_indices_at<RC>(get_simd_level(), src, n, indices);
+}
+
+/// Result of the bulk operations that check values, e.g. dst[0, first_violation) holds the values convert() stored.
+struct bulk_result {
+  /// Index of the first element that is out of range, the number of elements when none is.
+  size_t first_violation;
+  /// Number of the elements that are out of range.
+  size_t violations;
+};
+
+namespace detail {
+
+template<class T>
+struct is_range_constrained : std::false_type {};
+
+template<class T, T First, T Last, class Policy>
+struct is_range_constrained<RangeConstrained<T, First, Last, Policy> > : std::true_type {};
+
+/// Value type and bounds of the elements convert() reads, a subtype or a base type.
+template<class Src, bool = is_range_constrained<Src>::value>
+struct source_traits {
+  typedef Src T;
+  typedef typename integral_of<Src>::type integral;
+  static constexpr integral first() { return std::numeric_limits<integral>::min(); }
+  static constexpr integral last() { return std::numeric_limits<integral>::max(); }
+};
+
+template<class Src>
+struct source_traits<Src, true> {
+  typedef typename bulk_traits<Src>::T T;
+  typedef typename bulk_traits<Src>::integral integral;
+  static constexpr integral first() { return (integral)Src::first(); }
+  static constexpr integral last() { return (integral)Src::last(); }
+};
+
+/// a < b for integers of any signedness, like std::cmp_less of C++20.
+template<class A, class B>
+constexpr bool cmp_less(A a, B b, std::integral_constant<int, 0>) {
+  return a < b;
+}
+
+template<class A, class B>
+constexpr bool cmp_less(A a, B b, std::integral_constant<int, 1>) {
+  return a < 0 || (unsigned long long)a < (unsigned long long)b;
+}
+
+template<class A, class B>
+constexpr bool cmp_less(A a, B b, std::integral_constant<int, 2>) {
+  return b > 0 && (unsigned long long)a < (unsigned long long)b;
+}
+
+template<class A, class B>
+constexpr bool cmp_less(A a, B b) {
+  return cmp_less(a, b, std::integral_constant<int,
+      std::is_signed<A>::value == std::is_signed<B>::value ? 0 : std::is_signed<A>::value ? 1 : 2>());
+}
+
+/**
+ * The range of RC seen from the source type. When every source value is in
+ * range, the conversion is a plain copy.
+ */
+template<class RC, class Src>
+struct convert_traits {
+  typedef source_traits<Src> source;
+  typedef typename source::T S;
+  typedef typename source::integral SI;
+  typedef typename bulk_traits<RC>::T T;
+  typedef typename bulk_traits<RC>::integral DI;
+
+  static constexpr DI first() { return (DI)RC::first(); }
+  static constexpr DI last() { return (DI)RC::last(); }
+
+  static constexpr bool fits() {
+    return !cmp_less(source::first(), first()) && !cmp_less(last(), source::last());
+  }
+
+  static constexpr bool empty() {
+    return cmp_less(source::last(), first()) || cmp_less(last(), source::first());
+  }
+
+  /// The range in the source type, meaningful when it is not empty.
+  static constexpr SI lo() { return cmp_less(source::first(), first()) ? (SI)first() : source::first(); }
+  static constexpr SI hi() { return cmp_less(last(), source::last()) ? (SI)last() : source::last(); }
+
+  static bool in_range(S v) {
+    return !cmp_less((SI)v, first()) && !cmp_less(last(), (SI)v);
+  }
+
+  static const bool simd = sizeof(SI) == 4 && sizeof(DI) <= 4 && !std::is_same<DI, bool>::value &&
+                           !std::is_same<SI, wchar_t>::value;
+};
+
+/// Converts src[i, n) one by one, stores only before the first violation.
+template<class RC, class Src>
+bulk_result convert_scalar(const typename convert_traits<RC, Src>::S* src, size_t i, size_t n,
+                              typename RC::value_type* dst) {
+  typedef convert_traits<RC, Src> traits;
+  bulk_result result = { n, 0 };
+  for (; i < n; ++i) {
+    if (traits::in_range(src[i])) {
+      if (result.violations == 0) {
+        dst[i] = (typename traits::T)(typename traits::DI)(typename traits::SI)src[i];
+      }
+    } else {
+      if (result.violations++ == 0) {
+        result.first_violation = i;
+      }
+    }
+  }
+  return result;
+}
+
+template<class RC, class Src>
+bulk_result convert_at(simd_level level, const Src* src, size_t n, RC* dst) {
+  typedef convert_traits<RC, Src> traits;
+  typedef typename traits::S S;
+  typedef typename traits::T T;
+  typedef typename traits::SI SI;
+  typedef typename traits::DI DI;
+  const S* in = reinterpret_cast<const S*>(src);
+  T* out = reinterpret_cast<T*>(dst);
+  if (traits::fits()) {
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = (T)(DI)(SI)in[i];
+    }
+    bulk_result result = { n, 0 };
+    return result;
+  }
+  size_t i = 0;
+#if CT_BULK_X86
+  if (traits::simd && !traits::empty() && level >= SIMD_SSE42) {
+    static const unsigned size = sizeof(DI);
+    static const bool is_signed = std::is_signed<DI>::value;
+    const uint32_t* in32 = reinterpret_cast<const uint32_t*>(in);
+    const uint32_t lo = (uint32_t)traits::lo(), hi = (uint32_t)traits::hi();
+    const bool src_signed = std::is_signed<SI>::value;
+    i = level >= SIMD_AVX512 ? convert32_avx512<size, is_signed>(in32, n, out, lo, hi, src_signed)
+      : level >= SIMD_AVX2 ? convert32_avx2<size, is_signed>(in32, n, out, lo, hi, src_signed)
+                           : convert32_sse42<size, is_signed>(in32, n, out, lo, hi, src_signed);
+  }
+#endif
+  (void)level;
+  return convert_scalar<RC, Src>(in, i, n, out);
+}
+
+}
+
+/**
+ * Converts src[0, n) to the subtype RC, which may have a narrower base type.
+ * Src is a base type or another subtype. The elements are stored up to the
+ * first one that is out of range, the rest of dst is left unchanged. When
+ * every value of Src is in the range of RC no check is made.
+ */
+template<class RC, class Src>
+bulk_result convert(const Src* src, size_t n, RC* dst) {
+  return detail::convert_at<RC>(get_simd_level(), src, n, dst);
+}
+
+/// What the bulk arithmetic does with results out of range.
+enum bulk_mode {
+  /// Nothing is stored unless every result is in range.
+  BULK_ALL_OR_NOTHING,
+  /// Results out of range are replaced by the nearest bound.
+  BULK_SATURATE
+};
+
+namespace detail {
+
+enum arithmetic_op { OP_ADD, OP_SUB, OP_MUL, OP_SHL, OP_SHR };
+
+enum arithmetic_pass { PASS_CHECK, PASS_APPLY, PASS_SATURATE };
+
+/**
+ * The lane type of an operation on T, wide enough to hold every exact result
+ * so that no result wraps around before it is checked. Shift counts are below
+ * 32, like for the shifts of 32 bit values. Products and left shifts of
+ * unsigned 32 bit values only fit unsigned 64 bit lanes.
+ */
+template<class T, int Op>
+struct arithmetic_lane {
+  static const bool is_signed = std::is_signed<T>::value;
+  static const bool narrow =
+      Op == OP_ADD || Op == OP_SUB ? sizeof(T) <= 2 :
+      Op == OP_MUL ? sizeof(T) == 1 || (sizeof(T) == 2 && is_signed) :
+      Op == OP_SHR ? sizeof(T) <= 2 || is_signed : false;
+  static const bool unsigned_wide = !narrow && !is_signed && (Op == OP_MUL || Op == OP_SHL);
+  typedef typename std::conditional<narrow, int32_t,
+          typename std::conditional<unsigned_wide, uint64_t, int64_t>::type>::type type;
+};
+
+template<int Op, class W>
+inline W apply_scalar(W x, W y) {
+  return Op == OP_ADD ? x + y : Op == OP_SUB ? x - y : Op == OP_MUL ? x * y :
+         Op == OP_SHL ? x * ((W)1 << y) : x >> y;
+}
+
+/// Applies Op to data[0, n) with other[i] or scalar, returns the number of results out of [lo, hi].
+template<class T, class W, int Op, int Pass, bool Elementwise>
+size_t arithmetic_scalar(T* data, size_t n, const T* other, W scalar, W lo, W hi) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    W r = apply_scalar<Op>((W)data[i], Elementwise ? (W)other[i] : scalar);
+    const bool out = r < lo || r > hi;
+    count += out ? 1 : 0;
+    if (Pass == PASS_SATURATE) {
+      r = r < lo ? lo : r > hi ? hi : r;
+    }
+    if (Pass != PASS_CHECK) {
+      data[i] = (T)r;
+    }
+  }
+  return count;
+}
+
+/// Index of the first result out of [lo, hi], n when there is none.
+template<class T, class W, int Op, bool Elementwise>
+size_t first_out_of_range(const T* data, size_t n, const T* other, W scalar, W lo, W hi) {
+  for (size_t i = 0; i < n; ++i) {
+    W r = apply_scalar<Op>((W)data[i], Elementwise ? (W)other[i] : scalar);
+    if (r < lo || r > hi) {
+      return i;
+    }
+  }
+  return n;
+}
+
+#if CT_BULK_VECTORS
+
+template<class T, unsigned Lanes>
+struct vector_of {
+  typedef T type __attribute__((vector_size(Lanes * sizeof(T))));
+};
+
+/**
+ * Defines the arithmetic kernel NAME for vectors of BYTES bytes, compiled with
+ * the TARGET attribute. Each vector of T is widened to lanes of W, computed,
+ * compared with both bounds at once and narrowed back. The body is in a macro
+ * because GCC lowers vectors that are wider than the target of a function
+ * before inlining it, so the loop must be in the function with the attribute.
+ */
+#define CT_ARITHMETIC_KERNEL(NAME, TARGET, BYTES)                                           \
+template<class T, class W, int Op, int Pass, bool Elementwise>                              \
+TARGET size_t NAME(T* data, size_t n, const T* other, W scalar, W lo, W hi) {               \
+  static const unsigned lanes = BYTES / sizeof(W);                                          \
+  typedef typename vector_of<T, lanes>::type narrow_vector;                                 \
+  typedef typename vector_of<W, lanes>::type wide_vector;                                   \
+  const wide_vector vlo = wide_vector() + lo, vhi = wide_vector() + hi;                     \
+  wide_vector y = wide_vector() + scalar, counts = wide_vector();                           \
+  size_t i = 0;                                                                             \
+  for (; i + lanes <= n; i += lanes) {                                                      \
+    narrow_vector a;                                                                        \
+    std::memcpy(&a, data + i, sizeof(a));                                                   \
+    if (Elementwise) {                                                                      \
+      narrow_vector b;                                                                      \
+      std::memcpy(&b, other + i, sizeof(b));                                                \
+      y = __builtin_convertvector(b, wide_vector);                                          \
+    }                                                                                       \
+    const wide_vector x = __builtin_convertvector(a, wide_vector);                          \
+    wide_vector r;                                                                          \
+    if (Op == OP_ADD) r = x + y;                                                            \
+    else if (Op == OP_SUB) r = x - y;                                                       \
+    else if (Op == OP_MUL) r = x * y;                                                       \
+    else if (Op == OP_SHL) r = x << y;                                                      \
+    else r = x >> y;                                                                        \
+    const wide_vector below = r < vlo, above = r > vhi;                                     \
+    counts -= below | above;                                                                \
+    if (Pass == PASS_SATURATE) {                                                            \
+      r = (below & vlo) | (above & vhi) | (~(below | above) & r);                           \
+    }                                                                                       \
+    if (Pass != PASS_CHECK) {                                                               \
+      const narrow_vector result = __builtin_convertvector(r, narrow_vector);               \
+      std::memcpy(data + i, &result, sizeof(result));                                       \
+    }                                                                                       \
+  }                                                                                         \
+  size_t count = 0;                                                                         \
+  for (unsigned lane = 0; lane < lanes; ++lane) {                                           \
+    count += (size_t)counts[lane];                                                          \
+  }                                                                                         \
+  return count + arithmetic_scalar<T, W, Op, Pass, Elementwise>(                            \
+      data + i, n - i, Elementwise ? other + i : other, scalar, lo, hi);                    \
+}
+
+#if CT_BULK_X86
+CT_ARITHMETIC_KERNEL(arithmetic_sse42, CT_TARGET_SSE42, 16)
+CT_ARITHMETIC_KERNEL(arithmetic_avx2, CT_TARGET_AVX2, 32)
+CT_ARITHMETIC_KERNEL(arithmetic_avx512, CT_TARGET_AVX512, 64)
+#else
+CT_ARITHMETIC_KERNEL(arithmetic_baseline, , 16)
+#endif
+
+#endif
+
+template<class T, class W, int Op, int Pass, bool Elementwise>
+size_t arithmetic_pass(simd_level level, T* data, size_t n, const T* other, W scalar, W lo, W hi) {
+#if CT_BULK_VECTORS && CT_BULK_X86
+  if (level >= SIMD_AVX512) {
+    return arithmetic_avx512<T, W, Op, Pass, Elementwise>(data, n, other, scalar, lo, hi);
+  }
+  if (level >= SIMD_AVX2) {
+    return arithmetic_avx2<T, W, Op, Pass, Elementwise>(data, n, other, scalar, lo, hi);
+  }
+  if (level >= SIMD_SSE42) {
+    return arithmetic_sse42<T, W, Op, Pass, Elementwise>(data, n, other, scalar, lo, hi);
+  }
+#elif CT_BULK_VECTORS
+  return arithmetic_baseline<T, W, Op, Pass, Elementwise>(data, n, other, scalar, lo, hi);
+#endif
+  (void)level;
+  return arithmetic_scalar<T, W, Op, Pass, Elementwise>(data, n, other, scalar, lo, hi);
+}
+
+/// Elements per block of the saturating mode, which checks each block before it changes it.
+static const size_t SATURATE_BLOCK = 4096;
+
+template<int Op, bool Elementwise, class RC>
+bulk_result arithmetic_at(simd_level level, RC* data, size_t n,
+                          const typename RC::value_type* other,
+                          typename arithmetic_lane<typename bulk_traits<RC>::integral, Op>::type scalar,
+                          bulk_mode mode) {
+  typedef typename bulk_traits<RC>::integral T;
+  typedef typename arithmetic_lane<T, Op>::type W;
+  static_assert(sizeof(T) <= 4 && !std::is_same<T, bool>::value,
+                "the bulk arithmetic supports base types of up to 32 bits");
+  T* values = reinterpret_cast<T*>(data);
+  const T* operands = reinterpret_cast<const T*>(other);
+  const W lo = (W)bulk_traits<RC>::lo(), hi = (W)bulk_traits<RC>::hi();
+  bulk_result result = { n, 0 };
+  if (mode == BULK_ALL_OR_NOTHING) {
+    result.violations = arithmetic_pass<T, W, Op, PASS_CHECK, Elementwise>(level, values, n, operands, scalar, lo, hi);
+    if (result.violations == 0) {
+      arithmetic_pass<T, W, Op, PASS_APPLY, Elementwise>(level, values, n, operands, scalar, lo, hi);
+    } else {
+      result.first_violation = first_out_of_range<T, W, Op, Elementwise>(values, n, operands, scalar, lo, hi);
+    }
+    return result;
+  }
+  for (size_t i = 0; i < n; i += SATURATE_BLOCK) {
+    const size_t count = n - i < SATURATE_BLOCK ? n - i : SATURATE_BLOCK;
+    const T* block_operands = Elementwise ? operands + i : operands;
+    const size_t violations =
+        arithmetic_pass<T, W, Op, PASS_CHECK, Elementwise>(level, values + i, count, block_operands, scalar, lo, hi);
+    if (violations == 0) {
+      arithmetic_pass<T, W, Op, PASS_APPLY, Elementwise>(level, values + i, count, block_operands, scalar, lo, hi);
+      continue;
+    }
+    if (result.violations == 0) {
+      result.first_violation = i + first_out_of_range<T, W, Op, Elementwise>(values + i, count, block_operands, scalar, lo, hi);
+    }
+    result.violations += violations;
+    arithmetic_pass<T, W, Op, PASS_SATURATE, Elementwise>(level, values + i, count, block_operands, scalar, lo, hi);
+  }
+  return result;
+}
+
+}
+
+/**
+ * data[i] += delta for every element of data[0, n). The results are computed
+ * exactly, in lanes twice as wide as the base type, and checked all at once.
+ * In BULK_ALL_OR_NOTHING mode data is left unchanged when any result is out of
+ * range, in BULK_SATURATE mode those results are clamped. The returned
+ * violations are the results that were out of range.
+ */
+template<class RC>
+bulk_result bulk_add(RC* data, size_t n, typename RC::value_type delta, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  return detail::arithmetic_at<detail::OP_ADD, false>(get_simd_level(), data, n, nullptr, delta, mode);
+}
+
+/**
+ * data[i] += other[i], other must have n elements. The operands are deduced,
+ * so that a literal 0 is not taken for a null pointer.
+ */
+template<class RC, class T>
+bulk_result bulk_add(RC* data, size_t n, const T* other, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  static_assert(std::is_same<T, typename RC::value_type>::value, "the operands must have the base type");
+  return detail::arithmetic_at<detail::OP_ADD, true>(get_simd_level(), data, n, other, 0, mode);
+}
+
+template<class RC>
+bulk_result bulk_sub(RC* data, size_t n, typename RC::value_type delta, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  return detail::arithmetic_at<detail::OP_SUB, false>(get_simd_level(), data, n, nullptr, delta, mode);
+}
+
+template<class RC, class T>
+bulk_result bulk_sub(RC* data, size_t n, const T* other, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  static_assert(std::is_same<T, typename RC::value_type>::value, "the operands must have the base type");
+  return detail::arithmetic_at<detail::OP_SUB, true>(get_simd_level(), data, n, other, 0, mode);
+}
+
+template<class RC>
+bulk_result bulk_mul(RC* data, size_t n, typename RC::value_type factor, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  return detail::arithmetic_at<detail::OP_MUL, false>(get_simd_level(), data, n, nullptr, factor, mode);
+}
+
+template<class RC, class T>
+bulk_result bulk_mul(RC* data, size_t n, const T* other, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  static_assert(std::is_same<T, typename RC::value_type>::value, "the operands must have the base type");
+  return detail::arithmetic_at<detail::OP_MUL, true>(get_simd_level(), data, n, other, 0, mode);
+}
+
+/// Shifts left by count bits, or right by -count bits when count is negative. |count| must be below 32.
+template<class RC>
+bulk_result bulk_shift(RC* data, size_t n, int count, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  if (count < 0) {
+    return detail::arithmetic_at<detail::OP_SHR, false>(get_simd_level(), data, n, nullptr, -count, mode);
+  }
+  return detail::arithmetic_at<detail::OP_SHL, false>(get_simd_level(), data, n, nullptr, count, mode);
+}
+
+namespace detail {
+
+/// Clamps src[0, n) into dst, returns the number of elements that were out of range when Count.
+template<class RC, bool Count>
+size_t clamp_scalar(const typename bulk_traits<RC>::lane* src, size_t n, typename bulk_traits<RC>::lane* dst) {
+  typedef typename bulk_traits<RC>::lane L;
+  const L lo = (L)bulk_traits<RC>::lo(), hi = (L)bulk_traits<RC>::hi();
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const L v = src[i];
+    if (Count) {
+      count += v < lo || v > hi ? 1 : 0;
+    }
+    dst[i] = v < lo ? lo : v > hi ? hi : v;
+  }
+  return count;
+}
+
+#if CT_BULK_VECTORS
+
+/**
+ * Defines the clamping kernel NAME, see CT_ARITHMETIC_KERNEL. The bounds are
+ * constants of the instantiation. Lanes count the elements that changed in
+ * blocks of 64 vectors, so that even byte lanes do not overflow.
+ */
+#define CT_CLAMP_KERNEL(NAME, TARGET, BYTES)                                                \
+template<class RC, bool Count>                                                              \
+TARGET size_t NAME(const typename bulk_traits<RC>::lane* src, size_t n,                     \
+                   typename bulk_traits<RC>::lane* dst) {                                   \
+  typedef typename bulk_traits<RC>::lane L;                                                 \
+  static const unsigned lanes = BYTES / sizeof(L);                                          \
+  typedef typename vector_of<L, lanes>::type vector;                                        \
+  const vector lo = vector() + (L)bulk_traits<RC>::lo();                                    \
+  const vector hi = vector() + (L)bulk_traits<RC>::hi();                                    \
+  size_t i = 0, count = 0;                                                                  \
+  while (i + lanes <= n) {                                                                  \
+    decltype(lo < hi) counts = decltype(lo < hi)();                                         \
+    for (unsigned k = 0; k < 64 && i + lanes <= n; ++k, i += lanes) {                       \
+      vector v;                                                                             \
+      std::memcpy(&v, src + i, sizeof(v));                                                  \
+      const decltype(lo < hi) below = v < lo, above = v > hi;                               \
+      if (Count) {                                                                          \
+        counts -= below | above;                                                            \
+      }                                                                                     \
+      v = (below & lo) | (above & hi) | (~(below | above) & v);                             \
+      std::memcpy(dst + i, &v, sizeof(v));                                                  \
+    }                                                                                       \
+    if (Count) {                                                                            \
+      for (unsigned lane = 0; lane < lanes; ++lane) {                                       \
+        count += (size_t)counts[lane];                                                      \
+      }                                                                                     \
+    }                                                                                       \
+  }                                                                                         \
+  return count + clamp_scalar<RC, Count>(src + i, n - i, dst + i);                          \
+}
+
+#if CT_BULK_X86
+CT_CLAMP_KERNEL(clamp_sse42, CT_TARGET_SSE42, 16)
+CT_CLAMP_KERNEL(clamp_avx2, CT_TARGET_AVX2, 32)
+CT_CLAMP_KERNEL(clamp_avx512, CT_TARGET_AVX512, 64)
+#else
+CT_CLAMP_KERNEL(clamp_baseline, , 16)
+#endif
+
+#endif
+
+template<class RC, bool Count>
+size_t clamp_pass(simd_level level, const typename bulk_traits<RC>::lane* src, size_t n,
+                  typename bulk_traits<RC>::lane* dst) {
+#if CT_BULK_VECTORS && CT_BULK_X86
+  if (level >= SIMD_AVX512) {
+    return clamp_avx512<RC, Count>(src, n, dst);
+  }
+  if (level >= SIMD_AVX2) {
+    return clamp_avx2<RC, Count>(src, n, dst);
+  }
+  if (level >= SIMD_SSE42) {
+    return clamp_sse42<RC, Count>(src, n, dst);
+  }
+#elif CT_BULK_VECTORS
+  return clamp_baseline<RC, Count>(src, n, dst);
+#endif
+  (void)level;
+  return clamp_scalar<RC, Count>(src, n, dst);
+}
+
+/// dst may be src. Counts only when modified is not null.
+template<class RC>
+void clamp_at(simd_level level, const typename RC::value_type* src, size_t n, RC* dst, size_t* modified) {
+  typedef typename bulk_traits<RC>::lane L;
+  const L* in = reinterpret_cast<const L*>(src);
+  L* out = reinterpret_cast<L*>(dst);
+  if (modified != nullptr) {
+    *modified = clamp_pass<RC, true>(level, in, n, out);
+  } else {
+    clamp_pass<RC, false>(level, in, n, out);
+  }
+}
+
+}
+
+/**
+ * Clamps the elements of data[0, n) that are out of the range of RC to the
+ * nearest bound, in place, and returns the same memory as an array of RC.
+ * When modified is not null it receives the number of elements that changed.
+ */
+template<class RC>
+RC* clamp_into(typename RC::value_type* data, size_t n, size_t* modified = nullptr) {
+  RC* clamped = reinterpret_cast<RC*>(data);
+  detail::clamp_at<RC>(get_simd_level(), data, n, clamped, modified);
+  return clamped;
+}
+
+/// Same as clamp_into(), but stores the clamped values into dst and leaves src unchanged.
+template<class RC>
+void clamp_copy(const typename RC::value_type* src, size_t n, RC* dst, size_t* modified = nullptr) {
+  detail::clamp_at<RC>(get_simd_level(), src, n, dst, modified);
+}
+
+namespace detail {
+
+/**
+ * Accumulators of sum(). The lanes of the vector kernels accumulate at most
+ * per_lane values of magnitude at most max(|First|, |Last|) before they are
+ * added to the total, so they are the narrowest integers that can take 64
+ * such values. The total has 64 bits, or 128 bits when 2^32 such values do
+ * not fit in 64 bits, and is exact for up to max_count values.
+ */
+template<class RC>
+struct sum_traits {
+  typedef typename bulk_traits<RC>::lane L;
+
+  static constexpr bool non_negative() { return !(bulk_traits<RC>::lo() < 0); }
+
+  static constexpr unsigned long long magnitude(long long v) { return v < 0 ? 0ull - (unsigned long long)v : (unsigned long long)v; }
+
+  static constexpr unsigned long long bound() {
+    return bulk_traits<RC>::is_signed ? (magnitude((long long)bulk_traits<RC>::lo()) > magnitude((long long)bulk_traits<RC>::hi()) ?
+                                         magnitude((long long)bulk_traits<RC>::lo()) : magnitude((long long)bulk_traits<RC>::hi()))
+                                      : (unsigned long long)bulk_traits<RC>::hi();
+  }
+
+  static constexpr unsigned long long largest(unsigned bytes) {
+    return (non_negative() ? ~0ull : ~0ull >> 1) >> (64 - 8 * bytes);
+  }
+
+  static constexpr bool fits(unsigned bytes) {
+    return sizeof(L) <= bytes && bound() <= largest(bytes) / 64;
+  }
+
+  static const bool vectorized = fits(8);
+
+  typedef typename std::conditional<fits(2), int16_t,
+          typename std::conditional<fits(4), int32_t, int64_t>::type>::type signed_accumulator;
+  typedef typename std::conditional<non_negative(), typename std::make_unsigned<signed_accumulator>::type,
+                                    signed_accumulator>::type accumulator;
+
+  /// Values per lane between two additions to the total, capped to keep blocks in the cache.
+  static constexpr unsigned long long per_lane() {
+    return bound() == 0 ? 4096 : largest(sizeof(accumulator)) / bound() < 4096 ? largest(sizeof(accumulator)) / bound() : 4096;
+  }
+
+#if defined(__SIZEOF_INT128__)
+  typedef typename std::conditional<non_negative(), unsigned __int128, __int128>::type wide_result;
+#else
+  typedef typename std::conditional<non_negative(), unsigned long long, long long>::type wide_result;
+#endif
+  /// 64 bits when 2^32 values of the largest magnitude fit in them.
+  typedef typename std::conditional<bound() <= (largest(8) >> 32),
+          typename std::conditional<non_negative(), unsigned long long, long long>::type,
+          wide_result>::type result;
+
+  static constexpr unsigned long long max_count() {
+    return sizeof(result) > 8 || bound() == 0 ? ~0ull : largest(8) / bound();
+  }
+};
+
+template<class RC>
+typename sum_traits<RC>::result sum_scalar(const typename bulk_traits<RC>::lane* data, size_t n) {
+  typename sum_traits<RC>::result total = 0;
+  for (size_t i = 0; i < n; ++i) {
+    total += data[i];
+  }
+  return total;
+}
+
+/// Minimum when Max is false, maximum otherwise, of data[0, n) with n > 0.
+template<class RC, bool Max>
+typename bulk_traits<RC>::lane extreme_scalar(const typename bulk_traits<RC>::lane* data, size_t n) {
+  typename bulk_traits<RC>::lane result = data[0];
+  for (size_t i = 1; i < n; ++i) {
+    result = (Max ? data[i] > result : data[i] < result) ? data[i] : result;
+  }
+  return result;
+}
+
+#if CT_BULK_VECTORS
+
+/**
+ * Defines the summing kernel NAME, see CT_ARITHMETIC_KERNEL. Four vectors of
+ * accumulators hide the latency of the additions, their lanes are added to
+ * the total after per_lane values.
+ */
+#define CT_SUM_KERNEL(NAME, TARGET, BYTES)                                                  \
+template<class RC>                                                                          \
+TARGET typename sum_traits<RC>::result NAME(const typename bulk_traits<RC>::lane* data,     \
+                                            size_t n) {                                     \
+  typedef sum_traits<RC> traits;                                                            \
+  typedef typename traits::accumulator A;                                                   \
+  typedef typename bulk_traits<RC>::lane L;                                                 \
+  static const unsigned lanes = BYTES / sizeof(A);                                          \
+  static const size_t step = 4 * lanes;                                                     \
+  typedef typename vector_of<L, lanes>::type narrow_vector;                                 \
+  typedef typename vector_of<A, lanes>::type wide_vector;                                   \
+  typename traits::result total = 0;                                                        \
+  size_t i = 0;                                                                             \
+  while (i + step <= n) {                                                                   \
+    const size_t block = (size_t)traits::per_lane() * step;                                 \
+    const size_t end = n - i < block ? i + (n - i) / step * step : i + block;               \
+    wide_vector acc[4] = { wide_vector(), wide_vector(), wide_vector(), wide_vector() };     \
+    for (; i < end; i += step) {                                                            \
+      for (unsigned k = 0; k < 4; ++k) {                                                    \
+        narrow_vector v;                                                                    \
+        std::memcpy(&v, data + i + k * lanes, sizeof(v));                                   \
+        acc[k] += __builtin_convertvector(v, wide_vector);                                  \
+      }                                                                                     \
+    }                                                                                       \
+    for (unsigned lane = 0; lane < lanes; ++lane) {                                         \
+      total += (typename traits::result)acc[0][lane] + acc[1][lane];                        \
+      total += (typename traits::result)acc[2][lane] + acc[3][lane];                        \
+    }                                                                                       \
+  }                                                                                         \
+  return total + sum_scalar<RC>(data + i, n - i);                                           \
+}
+
+/// Defines the kernel NAME of min() and max(), n must not be 0.
+#define CT_EXTREME_KERNEL(NAME, TARGET, BYTES)                                              \
+template<class RC, bool Max>                                                                \
+TARGET typename bulk_traits<RC>::lane NAME(const typename bulk_traits<RC>::lane* data,      \
+                                           size_t n) {                                      \
+  typedef typename bulk_traits<RC>::lane L;                                                 \
+  static const unsigned lanes = BYTES / sizeof(L);                                          \
+  static const size_t step = 4 * lanes;                                                     \
+  typedef typename vector_of<L, lanes>::type vector;                                        \
+  if (n < step) {                                                                           \
+    return extreme_scalar<RC, Max>(data, n);                                                \
+  }                                                                                         \
+  vector acc[4];                                                                            \
+  std::memcpy(acc, data, sizeof(acc));                                                      \
+  size_t i = step;                                                                          \
+  for (; i + step <= n; i += step) {                                                        \
+    for (unsigned k = 0; k < 4; ++k) {                                                      \
+      vector v;                                                                             \
+      std::memcpy(&v, data + i + k * lanes, sizeof(v));                                     \
+      const decltype(v < v) take = Max ? v > acc[k] : v < acc[k];                           \
+      acc[k] = (take & v) | (~take & acc[k]);                                               \
+    }                                                                                       \
+  }                                                                                         \
+  L result = acc[0][0];                                                                     \
+  for (unsigned k = 0; k < 4; ++k) {                                                        \
+    for (unsigned lane = 0; lane < lanes; ++lane) {                                         \
+      result = (Max ? acc[k][lane] > result : acc[k][lane] < result) ? acc[k][lane] : result; \
+    }                                                                                       \
+  }                                                                                         \
+  if (i < n) {                                                                              \
+    const L rest = extreme_scalar<RC, Max>(data + i, n - i);                                \
+    result = (Max ? rest > result : rest < result) ? rest : result;                         \
+  }                                                                                         \
+  return result;                                                                            \
+}
+
+#if CT_BULK_X86
+CT_SUM_KERNEL(sum_sse42, CT_TARGET_SSE42, 16)
+CT_SUM_KERNEL(sum_avx2, CT_TARGET_AVX2, 32)
+CT_SUM_KERNEL(sum_avx512, CT_TARGET_AVX512, 64)
+CT_EXTREME_KERNEL(extreme_sse42, CT_TARGET_SSE42, 16)
+CT_EXTREME_KERNEL(extreme_avx2, CT_TARGET_AVX2, 32)
+CT_EXTREME_KERNEL(extreme_avx512, CT_TARGET_AVX512, 64)
+#else
+CT_SUM_KERNEL(sum_baseline, , 16)
+CT_EXTREME_KERNEL(extreme_baseline, , 16)
+#endif
+
+#endif
+
+template<class RC>
+typename sum_traits<RC>::result sum_at(simd_level level, const RC* data, size_t n) {
+  typedef typename bulk_traits<RC>::lane L;
+  const L* values = reinterpret_cast<const L*>(data);
+  if (n > sum_traits<RC>::max_count()) {
+    throw std::overflow_error("the sum of the subtype values may overflow");
+  }
+  if (!sum_traits<RC>::vectorized) {
+    return sum_scalar<RC>(values, n);
+  }
+#if CT_BULK_VECTORS && CT_BULK_X86
+  if (level >= SIMD_AVX512) {
+    return sum_avx512<RC>(values, n);
+  }
+  if (level >= SIMD_AVX2) {
+    return sum_avx2<RC>(values, n);
+  }
+  if (level >= SIMD_SSE42) {
+    return sum_sse42<RC>(values, n);
+  }
+#elif CT_BULK_VECTORS
+  return sum_baseline<RC>(values, n);
+#endif
+  (void)level;
+  return sum_scalar<RC>(values, n);
+}
+
+template<class RC, bool Max>
+typename bulk_traits<RC>::lane extreme_pass(simd_level level, const typename bulk_traits<RC>::lane* values, size_t n) {
+#if CT_BULK_VECTORS && CT_BULK_X86
+  if (level >= SIMD_AVX512) {
+    return extreme_avx512<RC, Max>(values, n);
+  }
+  if (level >= SIMD_AVX2) {
+    return extreme_avx2<RC, Max>(values, n);
+  }
+  if (level >= SIMD_SSE42) {
+    return extreme_sse42<RC, Max>(values, n);
+  }
+#elif CT_BULK_VECTORS
+  return extreme_baseline<RC, Max>(values, n);
+#endif
+  (void)level;
+  return extreme_scalar<RC, Max>(values, n);
+}
+
+template<class RC, bool Max>
+RC extreme_at(simd_level level, const RC* data, size_t n) {
+  typedef typename bulk_traits<RC>::lane L;
+  typedef typename bulk_traits<RC>::T T;
+  if (n == 0) {
+    return RC(unchecked, Max ? RC::first() : RC::last());
+  }
+  return RC(unchecked, (T)extreme_pass<RC, Max>(level, reinterpret_cast<const L*>(data), n));
+}
+
+}
+
+/**
+ * Sum of data[0, n). The result type is wide enough for any sum of up to
+ * 2^32 values of RC. Throws std::overflow_error for longer buffers whose sum
+ * might not fit.
+ */
+template<class RC>
+typename detail::sum_traits<RC>::result sum(const RC* data, size_t n) {
+  return detail::sum_at(get_simd_level(), data, n);
+}
+
+/// Smallest value of data[0, n), RC::last() when n is 0.
+template<class RC>
+RC min(const RC* data, size_t n) {
+  return detail::extreme_at<RC, false>(get_simd_level(), data, n);
+}
+
+/// Largest value of data[0, n), RC::first() when n is 0.
+template<class RC>
+RC max(const RC* data, size_t n) {
+  return detail::extreme_at<RC, true>(get_simd_level(), data, n);
+}
+
+/// Mean of data[0, n), computed from the exact sum. NaN when n is 0.
+template<class RC>
+double mean(const RC* data, size_t n) {
+  if (n == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return (double)sum(data, n) / (double)n;
+}
+
+namespace detail {
+
+/**
+ * Joins the threads of a vector when it goes out of scope, so that an
+ * exception thrown while they run, or while more are started, does not
+ * destroy a joinable std::thread.
+ */
+class thread_joiner {
+public:
+  explicit thread_joiner(std::vector<std::thread>& threads) : threads(threads) {}
+  thread_joiner(const thread_joiner&) = delete;
+  thread_joiner& operator=(const thread_joiner&) = delete;
+
+  ~thread_joiner() {
+    for (size_t i = 0; i < threads.size(); ++i) {
+      if (threads[i].joinable()) {
+        threads[i].join();
+      }
+    }
+  }
+
+private:
+  std::vector<std::thread>& threads;
+};
+
+}
+
+/**
+ * Same as sum(), with the buffer split between threads. threads 0 uses one
+ * thread per processor. Short buffers are summed by the calling thread. The
+ * started threads are always joined: if the calling thread, a worker or the
+ * start of a worker throws, the first exception by buffer order is rethrown.
+ */
+template<class RC>
+typename detail::sum_traits<RC>::result parallel_sum(const RC* data, size_t n, unsigned threads = 0) {
+  typedef typename detail::sum_traits<RC>::result R;
+  static const size_t min_chunk = 1 << 16;
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  if (threads > n / min_chunk) {
+    threads = (unsigned)(n / min_chunk);
+  }
+  if (threads <= 1) {
+    return sum(data, n);
+  }
+  if (n > detail::sum_traits<RC>::max_count()) {
+    throw std::overflow_error("the sum of the subtype values may overflow");
+  }
+  const simd_level level = get_simd_level();
+  std::vector<R> partial(threads);
+  std::vector<std::exception_ptr> errors(threads);
+  std::vector<std::thread> workers;
+  workers.reserve(threads - 1);
+  const size_t chunk = n / threads;
+  {
+    detail::thread_joiner joiner(workers);
+    for (unsigned t = 1; t < threads; ++t) {
+      const size_t begin = t * chunk, count = t + 1 == threads ? n - begin : chunk;
+      workers.emplace_back([=, &partial, &errors]() {
+        try {
+          partial[t] = detail::sum_at(level, data + begin, count);
+        } catch (...) {
+          errors[t] = std::current_exception();
+        }
+      });
+    }
+    partial[0] = detail::sum_at(level, data, chunk);
+  }
+  R total = 0;
+  for (unsigned t = 1; t < threads; ++t) {
+    if (errors[t]) {
+      std::rethrow_exception(errors[t]);
+    }
+  }
+  for (unsigned t = 0; t < threads; ++t) {
+    total += partial[t];
+  }
+  return total;
+}
+
+namespace detail {
+
+/// A uniform 32 bit word from any uniform random bit generator.
+template<class URBG>
+uint32_t random32(URBG& rng, std::integral_constant<int, 32>) {
+  return (uint32_t)(rng() - URBG::min());
+}
+
+template<class URBG>
+uint32_t random32(URBG& rng, std::integral_constant<int, 64>) {
+  return (uint32_t)((rng() - URBG::min()) >> 32);
+}
+
+template<class URBG>
+uint32_t random32(URBG& rng, std::integral_constant<int, 0>) {
+  return std::uniform_int_distribution<uint32_t>(0, 0xffffffffu)(rng);
+}
+
+/// Bits of the words of URBG: 32, 64 or 0 when its range is not a power of two that can be used directly.
+template<class URBG>
+struct word_bits {
+  static const unsigned long long span = (unsigned long long)(URBG::max() - URBG::min());
+  static const int value = span == 0xffffffffull ? 32 : span == ~0ull ? 64 : 0;
+};
+
+template<class URBG>
+uint32_t random32(URBG& rng) {
+  return random32(rng, std::integral_constant<int, word_bits<URBG>::value>());
+}
+
+template<class URBG>
+uint64_t random64(URBG& rng) {
+  if (word_bits<URBG>::value == 64) {
+    return (uint64_t)(rng() - URBG::min());
+  }
+  const uint64_t high = random32(rng);
+  return high << 32 | random32(rng);
+}
+
+/**
+ * Lemire's nearly divisionless method: the high half of x * size is uniform
+ * in [0, size) once the rare x whose low half is below 2^32 mod size are
+ * rejected. The modulo is only computed when the low half is below size.
+ */
+template<class URBG>
+uint32_t bounded32(URBG& rng, uint64_t size) {
+  uint64_t m = (uint64_t)random32(rng) * size;
+  if ((uint32_t)m < size) {
+    const uint32_t threshold = (uint32_t)((1ull << 32) % size);
+    while ((uint32_t)m < threshold) {
+      m = (uint64_t)random32(rng) * size;
+    }
+  }
+  return (uint32_t)(m >> 32);
+}
+
+/// Same as bounded32 with 64 bit words, span is size - 1.
+template<class URBG>
+uint64_t bounded64(URBG& rng, uint64_t span) {
+  if (span == ~0ull) {
+    return random64(rng);
+  }
+#if defined(__SIZEOF_INT128__)
+  const uint64_t size = span + 1;
+  unsigned __int128 m = (unsigned __int128)random64(rng) * size;
+  if ((uint64_t)m < size) {
+    const uint64_t threshold = (0 - size) % size;
+    while ((uint64_t)m < threshold) {
+      m = (unsigned __int128)random64(rng) * size;
+    }
+  }
+  return (uint64_t)(m >> 64);
+#else
+  return std::uniform_int_distribution<uint64_t>(0, span)(rng);
+#endif
+}
+
+template<class RC>
+struct uniform_traits {
+  typedef typename bulk_traits<RC>::lane L;
+
+  /// range_size() - 1, which does not overflow for the full range of 64 bit types.
+  static constexpr uint64_t span() {
+    return (uint64_t)wide_traits<typename RC::value_type>::widen(RC::last()) -
+           (uint64_t)wide_traits<typename RC::value_type>::widen(RC::first());
+  }
+
+  static const bool narrow = span() <= 0xffffffffull;
+
+  static constexpr uint64_t first() {
+    return (uint64_t)wide_traits<typename RC::value_type>::widen(RC::first());
+  }
+};
+
+/// Maps words[0, n) to out, returns the number of words that Lemire's method rejects.
+template<class RC>
+size_t uniform_scalar(const uint32_t* words, size_t n, typename bulk_traits<RC>::lane* out, uint64_t size, uint32_t threshold) {
+  typedef typename bulk_traits<RC>::lane L;
+  size_t rejected = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const uint64_t m = (uint64_t)words[i] * size;
+    rejected += (uint32_t)m < threshold ? 1 : 0;
+    out[i] = (L)(uniform_traits<RC>::first() + (m >> 32));
+  }
+  return rejected;
+}
+
+#if CT_BULK_VECTORS
+
+/// Defines the kernel NAME of fill_uniform(), see CT_ARITHMETIC_KERNEL.
+#define CT_UNIFORM_KERNEL(NAME, TARGET, BYTES)                                              \
+template<class RC>                                                                          \
+TARGET size_t NAME(const uint32_t* words, size_t n, typename bulk_traits<RC>::lane* out,    \
+                   uint64_t size, uint32_t threshold) {                                     \
+  typedef typename bulk_traits<RC>::lane L;                                                 \
+  static const unsigned lanes = BYTES / sizeof(uint64_t);                                   \
+  typedef typename vector_of<uint32_t, lanes>::type word_vector;                            \
+  typedef typename vector_of<uint64_t, lanes>::type wide_vector;                            \
+  typedef typename vector_of<L, lanes>::type value_vector;                                  \
+  const wide_vector vsize = wide_vector() + size, vlimit = wide_vector() + threshold;       \
+  const wide_vector vfirst = wide_vector() + uniform_traits<RC>::first();                   \
+  const wide_vector low_half = wide_vector() + 0xffffffffull;                               \
+  decltype(vsize < vsize) rejected = decltype(vsize < vsize)();                             \
+  size_t i = 0;                                                                             \
+  for (; i + lanes <= n; i += lanes) {                                                      \
+    word_vector w;                                                                          \
+    std::memcpy(&w, words + i, sizeof(w));                                                  \
+    const wide_vector m = __builtin_convertvector(w, wide_vector) * vsize;                  \
+    rejected -= (m & low_half) < vlimit;                                                    \
+    const value_vector v = __builtin_convertvector(vfirst + (m >> 32), value_vector);       \
+    std::memcpy(out + i, &v, sizeof(v));                                                    \
+  }                                                                                         \
+  size_t count = 0;                                                                         \
+  for (unsigned lane = 0; lane < lanes; ++lane) {                                           \
+    count += (size_t)rejected[lane];                                                        \
+  }                                                                                         \
+  return count + uniform_scalar<RC>(words + i, n - i, out + i, size, threshold);            \
+}
+
+#if CT_BULK_X86
+CT_UNIFORM_KERNEL(uniform_sse42, CT_TARGET_SSE42, 16)
+CT_UNIFORM_KERNEL(uniform_avx2, CT_TARGET_AVX2, 32)
+CT_UNIFORM_KERNEL(uniform_avx512, CT_TARGET_AVX512, 64)
+#else
+CT_UNIFORM_KERNEL(uniform_baseline, , 16)
+#endif
+
+#endif
+
+template<class RC>
+size_t uniform_pass(simd_level level, const uint32_t* words, size_t n, typename bulk_traits<RC>::lane* out,
+                    uint64_t size, uint32_t threshold) {
+#if CT_BULK_VECTORS && CT_BULK_X86
+  if (level >= SIMD_AVX512) {
+    return uniform_avx512<RC>(words, n, out, size, threshold);
+  }
+  if (level >= SIMD_AVX2) {
+    return uniform_avx2<RC>(words, n, out, size, threshold);
+  }
+  if (level >= SIMD_SSE42) {
+    return uniform_sse42<RC>(words, n, out, size, threshold);
+  }
+#elif CT_BULK_VECTORS
+  return uniform_baseline<RC>(words, n, out, size, threshold);
+#endif
+  (void)level;
+  return uniform_scalar<RC>(words, n, out, size, threshold);
+}
+
+template<class RC, class URBG>
+typename bulk_traits<RC>::lane uniform_lane(URBG& rng) {
+  typedef uniform_traits<RC> traits;
+  if (traits::narrow) {
+    return (typename bulk_traits<RC>::lane)(traits::first() + bounded32(rng, traits::span() + 1));
+  }
+  return (typename bulk_traits<RC>::lane)(traits::first() + bounded64(rng, traits::span()));
+}
+
+/// Words drawn from the generator per call of the kernels.
+static const size_t UNIFORM_BATCH = 1024;
+
+/**
+ * Draws a batch of words, maps them all with the kernel and replaces the
+ * values of the rejected words, if any, with new draws.
+ */
+template<class RC, class URBG>
+void fill_uniform_at(simd_level level, RC* data, size_t n, URBG& rng) {
+  typedef uniform_traits<RC> traits;
+  typedef typename bulk_traits<RC>::lane L;
+  L* out = reinterpret_cast<L*>(data);
+  if (!traits::narrow) {
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = uniform_lane<RC>(rng);
+    }
+    return;
+  }
+  const uint64_t size = traits::span() + 1;
+  const uint32_t threshold = (uint32_t)((1ull << 32) % size);
+  uint32_t words[UNIFORM_BATCH];
+  for (size_t i = 0; i < n; i += UNIFORM_BATCH) {
+    const size_t count = n - i < UNIFORM_BATCH ? n - i : UNIFORM_BATCH;
+    for (size_t j = 0; j < count; ++j) {
+      words[j] = random32(rng);
+    }
+    if (uniform_pass<RC>(level, words, count, out + i, size, threshold) != 0) {
+      for (size_t j = 0; j < count; ++j) {
+        if ((uint32_t)((uint64_t)words[j] * size) < threshold) {
+          out[i + j] = uniform_lane<RC>(rng);
+        }
+      }
+    }
+  }
+}
+
+}
+
+/**
+ * A value of RC drawn uniformly with rng, a uniform random bit generator like
+ * std::mt19937. The value is in range by construction, so it is not checked.
+ */
+template<class RC, class URBG>
+RC uniform(URBG& rng) {
+  return RC(unchecked, (typename RC::value_type)detail::uniform_lane<RC>(rng));
+}
+
+/**
+ * Fills data[0, n) with values of RC drawn uniformly with rng. The words of
+ * the generator are drawn in batches and mapped to the range with vector
+ * instructions, so the values differ from those of successive uniform() calls.
+ */
+template<class RC, class URBG>
+void fill_uniform(RC* data, size_t n, URBG& rng) {
+  detail::fill_uniform_at(get_simd_level(), data, n, rng);
+}
+
+namespace detail {
+
+/// Index of the first element of data[0, n) that is out of range, n when there is none.
+template<class RC>
+size_t validate_scalar(const typename bulk_traits<RC>::lane* data, size_t n) {
+  typedef typename bulk_traits<RC>::lane L;
+  const L lo = (L)bulk_traits<RC>::lo(), hi = (L)bulk_traits<RC>::hi();
+  for (size_t i = 0; i < n; ++i) {
+    if (data[i] < lo || data[i] > hi) {
+      return i;
+    }
+  }
+  return n;
+}
+
+#if CT_BULK_VECTORS
+
+/**
+ * Defines the kernel NAME of first_violation(), see CT_ARITHMETIC_KERNEL. The
+ * comparisons of four vectors are combined before the branch, the scalar loop
+ * finds the element in the block that failed.
+ */
+#define CT_VALIDATE_KERNEL(NAME, TARGET, BYTES)                                             \
+template<class RC>                                                                          \
+TARGET size_t NAME(const typename bulk_traits<RC>::lane* data, size_t n) {                  \
+  typedef typename bulk_traits<RC>::lane L;                                                 \
+  static const unsigned lanes = BYTES / sizeof(L);                                          \
+  typedef typename vector_of<L, lanes>::type vector;                                        \
+  const vector lo = vector() + (L)bulk_traits<RC>::lo();                                    \
+  const vector hi = vector() + (L)bulk_traits<RC>::hi();                                    \
+  size_t i = 0;                                                                             \
+  for (; i + 4 * lanes <= n; i += 4 * lanes) {                                              \
+    vector v[4];                                                                            \
+    std::memcpy(v, data + i, sizeof(v));                                                    \
+    const decltype(lo < hi) bad = (v[0] < lo) | (v[0] > hi) | (v[1] < lo) | (v[1] > hi) |   \
+                                  (v[2] < lo) | (v[2] > hi) | (v[3] < lo) | (v[3] > hi);    \
+    uint64_t words[BYTES / 8], any = 0;                                                     \
+    std::memcpy(words, &bad, sizeof(words));                                                \
+    for (unsigned w = 0; w < BYTES / 8; ++w) {                                              \
+      any |= words[w];                                                                      \
+    }                                                                                       \
+    if (any != 0) {                                                                         \
+      break;                                                                                \
+    }                                                                                       \
+  }                                                                                         \
+  return i + validate_scalar<RC>(data + i, n - i);                                          \
+}
+
+#if CT_BULK_X86
+CT_VALIDATE_KERNEL(validate_sse42, CT_TARGET_SSE42, 16)
+CT_VALIDATE_KERNEL(validate_avx2, CT_TARGET_AVX2, 32)
+CT_VALIDATE_KERNEL(validate_avx512, CT_TARGET_AVX512, 64)
+#else
+CT_VALIDATE_KERNEL(validate_baseline, , 16)
+#endif
+
+#endif
+
+template<class RC>
+size_t first_violation_at(simd_level level, const typename RC::value_type* data, size_t n) {
+  typedef typename bulk_traits<RC>::lane L;
+  const L* in = reinterpret_cast<const L*>(data);
+#if CT_BULK_VECTORS && CT_BULK_X86
+  if (level >= SIMD_AVX512) {
+    return validate_avx512<RC>(in, n);
+  }
+  if (level >= SIMD_AVX2) {
+    return validate_avx2<RC>(in, n);
+  }
+  if (level >= SIMD_SSE42) {
+    return validate_sse42<RC>(in, n);
+  }
+#elif CT_BULK_VECTORS
+  return validate_baseline<RC>(in, n);
+#endif
+  (void)level;
+  return validate_scalar<RC>(in, n);
+}
+
+}
+
+/// Index of the first element of data[0, n) that is out of the range of RC, n when they are all in range.
+template<class RC>
+size_t first_violation(const typename RC::value_type* data, size_t n) {
+  return detail::first_violation_at<RC>(get_simd_level(), data, n);
+}
+
+/**
+ * Returns data[0, n) as an array of RC, without a copy, for buffers that are
+ * known to hold values in range. bulk_traits asserts that RC is stored exactly
+ * like its base type.
+ */
+template<class RC>
+const RC* view_as_unchecked(const typename RC::value_type* data, size_t n) {
+  (void)n;
+  (void)sizeof(detail::bulk_traits<RC>);
+  return reinterpret_cast<const RC*>(data);
+}
+
+/**
+ * Same as view_as_unchecked() after validating data[0, n). The first value out
+ * of range is reported by RC::report_violation(), whatever the check policy of
+ * RC, since a policy that skips checks would assume the value is in range.
+ */
+template<class RC>
+const RC* view_as(const typename RC::value_type* data, size_t n) {
+  const size_t bad = first_violation<RC>(data, n);
+  if (bad != n) {
+    RC::report_violation(data[bad]);
+  }
+  return view_as_unchecked<RC>(data, n);
+}
+
+namespace detail {
+
+/// Sets flags[i] when the field at field + i * Stride is out of range.
+template<class RC, size_t Stride>
+void field_scalar(const unsigned char* field, size_t n, int8_t* flags) {
+  typedef typename bulk_traits<RC>::lane L;
+  const L lo = (L)bulk_traits<RC>::lo(), hi = (L)bulk_traits<RC>::hi();
+  for (size_t i = 0; i < n; ++i) {
+    L v;
+    std::memcpy(&v, field + i * Stride, sizeof(v));
+    flags[i] |= (v < lo || v > hi) ? -1 : 0;
+  }
+}
+
+#if CT_BULK_VECTORS
+
+/**
+ * Defines the kernel NAME of validate_fields(), see CT_ARITHMETIC_KERNEL. The
+ * fields of a vector of records are gathered with strided loads, which GCC
+ * and clang turn into loads and shuffles for the constant stride, compared
+ * with both bounds and narrowed to one flag byte per record.
+ */
+#define CT_FIELD_KERNEL(NAME, TARGET, BYTES)                                                \
+template<class RC, size_t Stride>                                                           \
+TARGET void NAME(const unsigned char* field, size_t n, int8_t* flags) {                     \
+  typedef typename bulk_traits<RC>::lane L;                                                 \
+  static const unsigned lanes = BYTES / sizeof(L);                                          \
+  typedef typename vector_of<L, lanes>::type vector;                                        \
+  typedef typename vector_of<int8_t, lanes>::type flag_vector;                              \
+  const vector lo = vector() + (L)bulk_traits<RC>::lo();                                    \
+  const vector hi = vector() + (L)bulk_traits<RC>::hi();                                    \
+  size_t i = 0;                                                                             \
+  for (; i + lanes <= n; i += lanes) {                                                      \
+    vector v;                                                                               \
+    for (unsigned lane = 0; lane < lanes; ++lane) {                                         \
+      L value;                                                                              \
+      std::memcpy(&value, field + (i + lane) * Stride, sizeof(value));                      \
+      v[lane] = value;                                                                      \
+    }                                                                                       \
+    flag_vector f;                                                                          \
+    std::memcpy(&f, flags + i, sizeof(f));                                                  \
+    f |= __builtin_convertvector((v < lo) | (v > hi), flag_vector);                         \
+    std::memcpy(flags + i, &f, sizeof(f));                                                  \
+  }                                                                                         \
+  field_scalar<RC, Stride>(field + i * Stride, n - i, flags + i);                           \
+}
+
+#if CT_BULK_X86
+CT_FIELD_KERNEL(field_sse42, CT_TARGET_SSE42, 16)
+CT_FIELD_KERNEL(field_avx2, CT_TARGET_AVX2, 32)
+CT_FIELD_KERNEL(field_avx512, CT_TARGET_AVX512, 64)
+#else
+CT_FIELD_KERNEL(field_baseline, , 16)
+#endif
+
+#endif
+
+template<class RC, size_t Stride>
+void field_pass(simd_level level, const unsigned char* field, size_t n, int8_t* flags) {
+#if CT_BULK_VECTORS && CT_BULK_X86
+  if (level >= SIMD_AVX512) {
+    field_avx512<RC, Stride>(field, n, flags);
+    return;
+  }
+  if (level >= SIMD_AVX2) {
+    field_avx2<RC, Stride>(field, n, flags);
+    return;
+  }
+  if (level >= SIMD_SSE42) {
+    field_sse42<RC, Stride>(field, n, flags);
+    return;
+  }
+#elif CT_BULK_VECTORS
+  field_baseline<RC, Stride>(field, n, flags);
+  return;
+#endif
+  (void)level;
+  field_scalar<RC, Stride>(field, n, flags);
+}
+
+template<class Record>
+void flag_fields(simd_level, const Record*, size_t, int8_t*) {}
+
+/// Flags the records of records[0, count), count > 0, with any of the fields out of range.
+template<class Record, class RC, class... Members>
+void flag_fields(simd_level level, const Record* records, size_t count, int8_t* flags,
+                 RC Record::*member, Members... rest) {
+  static_assert(is_range_constrained<RC>::value, "the fields must be subtypes");
+  field_pass<RC, sizeof(Record)>(level, reinterpret_cast<const unsigned char*>(&(records->*member)), count, flags);
+  flag_fields(level, records, count, flags, rest...);
+}
+
+/// Records validated together, so that their fields are still in the L1 cache for the next member.
+static const size_t FIELD_BLOCK = 256;
+
+template<class Record, class... Members>
+size_t validate_fields_at(simd_level level, const Record* records, size_t n, uint32_t* bad, Members... members) {
+  int8_t flags[FIELD_BLOCK];
+  size_t k = 0;
+  for (size_t i = 0; i < n; i += FIELD_BLOCK) {
+    const size_t count = n - i < FIELD_BLOCK ? n - i : FIELD_BLOCK;
+    std::memset(flags, 0, count);
+    flag_fields(level, records + i, count, flags, members...);
+    for (size_t j = 0; j < count; ++j) {
+      bad[k] = (uint32_t)(i + j);
+      k += flags[j] != 0 ? 1 : 0;
+    }
+  }
+  return k;
+}
+
+#if defined(__cpp_nontype_template_parameter_auto)
+template<class Member>
+struct member_traits;
+
+template<class Record, class RC>
+struct member_traits<RC Record::*> {
+  typedef Record record;
+};
+
+template<auto Member, auto...>
+struct first_member {
+  typedef typename member_traits<decltype(Member)>::record record;
+};
+#endif
+
+}
+
+/**
+ * Writes the indices of the records of records[0, n) whose subtype member is
+ * out of range to bad and returns their number. bad must have room for n
+ * indices, and n must be below 2^32:
+ *
+ *   size_t count = ct::validate_field(records, n, &record::month, bad);
+ */
+template<class Record, class RC>
+size_t validate_field(const Record* records, size_t n, RC Record::*member, uint32_t* bad) {
+  return detail::validate_fields_at(get_simd_level(), records, n, bad, member);
+}
+
+/// Same as validate_field() for several members, in a single pass over the records.
+template<class Record, class... Members>
+size_t validate_fields(const Record* records, size_t n, uint32_t* bad, Members... members) {
+  return detail::validate_fields_at(get_simd_level(), records, n, bad, members...);
+}
+
+#if defined(__cpp_nontype_template_parameter_auto)
+/// Same as validate_field() with the member as a template argument, ct::validate_field<&record::month>(records, n, bad).
+template<auto Member>
+size_t validate_field(const typename detail::first_member<Member>::record* records, size_t n, uint32_t* bad) {
+  return detail::validate_fields_at(get_simd_level(), records, n, bad, Member);
+}
+
+template<auto... Members>
+size_t validate_fields(const typename detail::first_member<Members...>::record* records, size_t n, uint32_t* bad) {
+  return detail::validate_fields_at(get_simd_level(), records, n, bad, Members...);
+}
+#endif
+
+#if defined(__cpp_lib_span)
+/// Same as filter(), returns the leading part of dst that holds the selected elements.
+template<class RC>
+std::span<RC> filter(std::span<const typename RC::value_type> src, std::span<RC> dst) {
+  return dst.first(filter<RC>(src.data(), src.size(), dst.data()));
+}
+
+/// Same as select_indices(), returns the leading part of indices that was written.
+template<class RC>
+std::span<uint32_t> select_indices(std::span<const typename RC::value_type> src, std::span<uint32_t> indices) {
+  return indices.first(select_indices<RC>(src.data(), src.size(), indices.data()));
+}
+
+/// Same as convert(), dst must be at least as long as src.
+template<class RC, class Src>
+bulk_result convert(std::span<const Src> src, std::span<RC> dst) {
+  return convert<RC>(src.data(), src.size(), dst.data());
+}
+
+/// data[i] += delta for every element of data.
+template<class RC>
+bulk_result bulk_add(std::span<RC> data, typename RC::value_type delta, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  return bulk_add<RC>(data.data(), data.size(), delta, mode);
+}
+
+/// data[i] += other[i], other must be at least as long as data.
+template<class RC>
+bulk_result bulk_add(std::span<RC> data, std::span<const typename RC::value_type> other, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  return bulk_add<RC>(data.data(), data.size(), other.data(), mode);
+}
+
+/// data[i] -= delta for every element of data.
+template<class RC>
+bulk_result bulk_sub(std::span<RC> data, typename RC::value_type delta, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  return bulk_sub<RC>(data.data(), data.size(), delta, mode);
+}
+
+/// data[i] -= other[i], other must be at least as long as data.
+template<class RC>
+bulk_result bulk_sub(std::span<RC> data, std::span<const typename RC::value_type> other, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  return bulk_sub<RC>(data.data(), data.size(), other.data(), mode);
+}
+
+/// data[i] *= factor for every element of data.
+template<class RC>
+bulk_result bulk_mul(std::span<RC> data, typename RC::value_type factor, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  return bulk_mul<RC>(data.data(), data.size(), factor, mode);
+}
+
+/// data[i] *= other[i], other must be at least as long as data.
+template<class RC>
+bulk_result bulk_mul(std::span<RC> data, std::span<const typename RC::value_type> other, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  return bulk_mul<RC>(data.data(), data.size(), other.data(), mode);
+}
+
+/// Shifts left by count bits, or right by -count bits when count is negative. |count| must be below 32.
+template<class RC>
+bulk_result bulk_shift(std::span<RC> data, int count, bulk_mode mode = BULK_ALL_OR_NOTHING) {
+  return bulk_shift<RC>(data.data(), data.size(), count, mode);
+}
+
+/// Same as clamp_into(), returns the same memory as a span of RC.
+template<class RC>
+std::span<RC> clamp_into(std::span<typename RC::value_type> data, size_t* modified = nullptr) {
+  return std::span<RC>(clamp_into<RC>(data.data(), data.size(), modified), data.size());
+}
+
+/// Same as clamp_copy(), dst must be at least as long as src. Returns the part of dst that was written.
+template<class RC>
+std::span<RC> clamp_copy(std::span<const typename RC::value_type> src, std::span<RC> dst, size_t* modified = nullptr) {
+  clamp_copy<RC>(src.data(), src.size(), dst.data(), modified);
+  return dst.first(src.size());
+}
+
+/// Sum of data, see sum().
+template<class RC>
+typename detail::sum_traits<RC>::result sum(std::span<const RC> data) {
+  return sum(data.data(), data.size());
+}
+
+/// Smallest value of data, RC::last() when it is empty.
+template<class RC>
+RC min(std::span<const RC> data) {
+  return min(data.data(), data.size());
+}
+
+/// Largest value of data, RC::first() when it is empty.
+template<class RC>
+RC max(std::span<const RC> data) {
+  return max(data.data(), data.size());
+}
+
+/// Mean of data, computed from the exact sum. NaN when it is empty.
+template<class RC>
+double mean(std::span<const RC> data) {
+  return mean(data.data(), data.size());
+}
+
+/// Same as sum(), with data split between threads, see parallel_sum().
+template<class RC>
+typename detail::sum_traits<RC>::result parallel_sum(std::span<const RC> data, unsigned threads = 0) {
+  return parallel_sum(data.data(), data.size(), threads);
+}
+
+/// Fills data with values of RC drawn uniformly with rng.
+template<class RC, class URBG>
+void fill_uniform(std::span<RC> data, URBG& rng) {
+  fill_uniform(data.data(), data.size(), rng);
+}
+
+/// Index of the first element of data that is out of the range of RC, data.size() when they are all in range.
+template<class RC>
+size_t first_violation(std::span<const typename RC::value_type> data) {
+  return first_violation<RC>(data.data(), data.size());
+}
+
+/// Same as view_as(), data as a span of RC after validating it.
+template<class RC>
+std::span<const RC> view_as(std::span<const typename RC::value_type> data) {
+  return std::span<const RC>(view_as<RC>(data.data(), data.size()), data.size());
+}
+
+/// Same as view_as_unchecked(), data as a span of RC without validating it.
+template<class RC>
+std::span<const RC> view_as_unchecked(std::span<const typename RC::value_type> data) {
+  return std::span<const RC>(view_as_unchecked<RC>(data.data(), data.size()), data.size());
+}
+
+/// Same as validate_field(), returns the leading part of bad that holds the indices of the invalid records.
+template<auto Member>
+std::span<uint32_t> validate_field(std::span<const typename detail::first_member<Member>::record> records,
+                                   std::span<uint32_t> bad) {
+  return bad.first(validate_field<Member>(records.data(), records.size(), bad.data()));
+}
+
+/// Same as validate_fields(), returns the leading part of bad that holds the indices of the invalid records.
+template<auto... Members>
+std::span<uint32_t> validate_fields(std::span<const typename detail::first_member<Members...>::record> records,
+                                    std::span<uint32_t> bad) {
+  return bad.first(validate_fields<Members...>(records.data(), records.size(), bad.data()));
+}
+#endif
+
+}
+
+#endif
@@ -0,0 +1,287 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * The constraint_error hierarchy and the formatting of its message.
+ *
+ * This header is included by subtype_range_constrained.h and is kept free of
+ * <string> and <sstream>. The message is written into a fixed buffer inside
+ * the exception object.
+ *
+ * constraint_error_base derives from std::out_of_range, as constraint_error
+ * always did, so handlers of std::out_of_range and std::logic_error catch the
+ * violations. That needs <stdexcept>, which brings <string> with it. Defining
+ * CT_LIGHT_EXCEPTIONS for the whole program derives it from std::exception
+ * instead and keeps <stdexcept> out, which makes including the library about
+ * four times cheaper; such handlers then no longer catch violations.
+ *
+ * All the constraint_error classes derive from ct::constraint_error_base, so a
+ * single handler can catch the violations of every subtype:
+ *
+ *   try {
+ *     ...
+ *   } catch (const ct::constraint_error_base& e) {
+ *     std::cerr << e.what() << " in a subtype of " << e.descriptor().base_type << '\n';
+ *   }
+ *
+ * The subtypes of one base type T share their constraint_error class,
+ * detail::basic_constraint_error<T>, so a program has one typeinfo object per
+ * base type rather than one per subtype. A handler of month_t::constraint_error
+ * also catches the violations of the other subtypes of short; the address of
+ * descriptor() identifies the subtype.
+ */
+
+
+#ifndef SUBTYPE_RANGE_CONSTRAINED_ERROR_H
+#define SUBTYPE_RANGE_CONSTRAINED_ERROR_H
+
+#include <exception>
+#include <cstddef>
+#if !defined(CT_LIGHT_EXCEPTIONS)
+#  include <stdexcept>
+#endif
+#include <type_traits>
+
+namespace ConstrainedTypes {
+
+/**
+ * Location in the source of a check. It is only known when CT_SOURCE_LOCATION
+ * is defined, otherwise file and function are null and line is 0.
+ *
+ * current() is meant to be used as a default argument, it then returns the
+ * location of the caller.
+ */
+struct source_location {
+  const char* file;
+  unsigned line;
+  const char* function;
+
+#if defined(__GNUC__)
+  static constexpr source_location current(const char* file = __builtin_FILE(),
+                                           unsigned line = __builtin_LINE(),
+                                           const char* function = __builtin_FUNCTION()) {
+    return source_location{ file, line, function };
+  }
+#else
+  static constexpr source_location current() {
+    return source_location{ nullptr, 0, nullptr };
+  }
+#endif
+};
+
+/**
+ * Describes a range constrained subtype at runtime. There is a single instance
+ * per subtype (see RangeConstrained::descriptor()), so its address can be used
+ * to identify the subtype.
+ *
+ * Bounds are widened to long long. When is_signed is false they should be
+ * reinterpreted as unsigned long long.
+ */
+struct type_descriptor {
+  const char* base_type;  ///< Name of the base type, "enum" for enumerations.
+  unsigned size;          ///< sizeof of the base type.
+  bool is_signed;         ///< Whether the wide values are signed.
+  bool is_character;      ///< Whether values are printed as characters.
+  long long first;
+  long long last;
+};
+
+namespace detail {
+
+template<class T> struct base_type_name { static constexpr const char* value() { return "enum"; } };
+
+#define CT_BASE_TYPE_NAME(type) \
+  template<> struct base_type_name<type> { static constexpr const char* value() { return #type; } }
+
+CT_BASE_TYPE_NAME(bool);
+CT_BASE_TYPE_NAME(char);
+CT_BASE_TYPE_NAME(signed char);
+CT_BASE_TYPE_NAME(unsigned char);
+CT_BASE_TYPE_NAME(wchar_t);
+CT_BASE_TYPE_NAME(char16_t);
+CT_BASE_TYPE_NAME(char32_t);
+CT_BASE_TYPE_NAME(short);
+CT_BASE_TYPE_NAME(unsigned short);
+CT_BASE_TYPE_NAME(int);
+CT_BASE_TYPE_NAME(unsigned int);
+CT_BASE_TYPE_NAME(long);
+CT_BASE_TYPE_NAME(unsigned long);
+CT_BASE_TYPE_NAME(long long);
+CT_BASE_TYPE_NAME(unsigned long long);
+
+#undef CT_BASE_TYPE_NAME
+
+/// The integral type that holds the values of T, the underlying type for enumerations.
+template<class T, bool = std::is_enum<T>::value>
+struct integral_of { typedef T type; };
+
+template<class T>
+struct integral_of<T, true> { typedef typename std::underlying_type<T>::type type; };
+
+template<class T>
+struct wide_traits {
+  typedef typename integral_of<T>::type integral;
+
+  static const bool is_signed = std::is_signed<integral>::value;
+  static const bool is_character = std::is_same<T, char>::value ||
+                                   std::is_same<T, signed char>::value ||
+                                   std::is_same<T, unsigned char>::value;
+
+  /// Widens v to long long, keeping the bits of unsigned values.
+  static constexpr long long widen(T v) {
+    return is_signed ? (long long)(integral)v : (long long)(unsigned long long)(integral)v;
+  }
+};
+
+/// Large enough for "The value X is out of the range [F, L]" with 64 bit values.
+static const size_t ERROR_MESSAGE_SIZE = 128;
+
+/// Appends str to the buffer, returns the new end.
+inline char* append(char* out, char* end, const char* str) {
+  while (*str && out < end) {
+    *out++ = *str++;
+  }
+  return out;
+}
+
+inline char* append_unsigned(char* out, char* end, unsigned long long n) {
+  char digits[20];
+  int count = 0;
+  do {
+    digits[count++] = (char)('0' + n % 10);
+    n /= 10;
+  } while (n != 0);
+  while (count > 0 && out < end) {
+    *out++ = digits[--count];
+  }
+  return out;
+}
+
+/// Character types print as characters, the same way an ostream would print them.
+inline char* append_value(char* out, char* end, long long n, const type_descriptor& type) {
+  if (type.is_character) {
+    if (out < end) {
+      *out++ = (char)n;
+    }
+    return out;
+  }
+  if (type.is_signed && n < 0) {
+    out = append(out, end, "-");
+    return append_unsigned(out, end, 0ULL - (unsigned long long)n);
+  }
+  return append_unsigned(out, end, (unsigned long long)n);
+}
+
+/**
+ * Writes "The value <val> is out of the range [<first>, <last>]" into buf,
+ * which must hold ERROR_MESSAGE_SIZE characters.
+ */
+inline void format_constraint_error(char* buf, long long val, long long first, long long last,
+                                    const type_descriptor& type) {
+  char* end = buf + ERROR_MESSAGE_SIZE - 1;
+  char* out = buf;
+  out = append(out, end, "The value ");
+  out = append_value(out, end, val, type);
+  out = append(out, end, " is out of the range [");
+  out = append_value(out, end, first, type);
+  out = append(out, end, ", ");
+  out = append_value(out, end, last, type);
+  out = append(out, end, "]");
+  *out = '\0';
+}
+
+}
+
+namespace detail {
+
+#if defined(CT_LIGHT_EXCEPTIONS)
+typedef std::exception constraint_error_parent;
+#else
+/// Gives std::out_of_range an empty message, what() is overridden by constraint_error_base.
+class constraint_error_parent : public std::out_of_range {
+public:
+  constraint_error_parent() : std::out_of_range("") {}
+};
+#endif
+
+}
+
+/**
+ * Base of the constraint_error classes of all the subtypes. It carries the
+ * value and the bounds widened to long long, and the descriptor of the subtype.
+ * It derives from std::out_of_range, or from std::exception with
+ * CT_LIGHT_EXCEPTIONS.
+ */
+class constraint_error_base : public detail::constraint_error_parent {
+private:
+  const long long _val, _first, _last;
+  const type_descriptor* _type;
+  const source_location _where;
+  char _what[detail::ERROR_MESSAGE_SIZE];
+
+public:
+  constraint_error_base(long long val, long long first, long long last, const type_descriptor& type,
+                        const source_location& where = source_location()) :
+     _val(val), _first(first), _last(last), _type(&type), _where(where) {
+    detail::format_constraint_error(_what, val, first, last, type);
+  }
+
+  const char* what() const noexcept { return _what; }
+
+  inline long long getWideVal() const { return _val;}
+  inline long long getWideFirst() const { return _first;}
+  inline long long getWideLast() const { return _last;}
+  inline const type_descriptor& descriptor() const { return *_type;}
+
+  /// Where the value was checked, see source_location.
+  inline const source_location& where() const { return _where;}
+};
+
+namespace detail {
+
+/**
+ * The constraint_error of all the subtypes of T, with the value and the bounds
+ * as T. The descriptor tells the subtypes apart.
+ */
+template<class T>
+class basic_constraint_error : public constraint_error_base {
+public:
+  basic_constraint_error(T val, T first, T last, const type_descriptor& type,
+                         const source_location& where) :
+     constraint_error_base(wide_traits<T>::widen(val), wide_traits<T>::widen(first),
+                           wide_traits<T>::widen(last), type, where) {}
+
+  inline const T getVal() const { return (T)(typename wide_traits<T>::integral)getWideVal();}
+  inline const T getFirst() const { return (T)(typename wide_traits<T>::integral)getWideFirst();}
+  inline const T getLast() const { return (T)(typename wide_traits<T>::integral)getWideLast();}
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,416 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Asynchronous log of violations.
+ *
+ * Enabled by defining CT_ASYNC_LOG for the whole program, in which case it is
+ * included by subtype_range_constrained.h. Once the logger is started, the
+ * throw path enqueues a small binary record into a bounded lock-free queue.
+ * Enqueueing never blocks and never allocates: when the queue is full the
+ * record is dropped and counted. A background thread drains the queue, applies
+ * the rate limits and writes one line per violation to a rotating file:
+ *
+ *   ct::logger::options opts;
+ *   opts.path = "/var/log/app/violations.log";
+ *   ct::logger::start(opts);
+ *   ...
+ *   ct::logger::stop();  // also called at exit
+ *
+ * The rate limits are applied by the background thread, per subtype and per
+ * call site (with CT_SOURCE_LOCATION). Violations over the limit are counted
+ * and reported in a single line when the second ends.
+ */
+
+
+#ifndef SUBTYPE_RANGE_CONSTRAINED_LOGGER_H
+#define SUBTYPE_RANGE_CONSTRAINED_LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include "subtype_range_constrained_error.h"
+
+/// Capacity of the queue, a power of two.
+#ifndef CT_ASYNC_LOG_QUEUE_SIZE
+#  define CT_ASYNC_LOG_QUEUE_SIZE 4096
+#endif
+
+namespace ConstrainedTypes {
+namespace logger {
+
+struct options {
+  std::string path;
+  unsigned long long max_file_size;  ///< Rotate when the file grows beyond this size.
+  unsigned max_files;                ///< Rotated files kept as path.1 ... path.N.
+  unsigned per_type_per_second;      ///< 0 for no limit.
+  unsigned per_site_per_second;      ///< 0 for no limit.
+  unsigned poll_interval_ms;         ///< How often the background thread drains the queue.
+
+  options() :
+     path("ct_violations.log"), max_file_size(16 << 20), max_files(4),
+     per_type_per_second(100), per_site_per_second(10), poll_interval_ms(20) {}
+};
+
+namespace detail {
+
+struct log_record {
+  long long timestamp_ns;
+  long long value;
+  const type_descriptor* type;
+  source_location where;
+};
+
+/**
+ * Bounded multi producer, single consumer queue. Each cell carries a sequence
+ * number that tells whether it is free for the producer that claimed its
+ * position or ready for the consumer, so a producer only has to win a single
+ * compare and swap and never waits for another producer.
+ */
+class queue {
+private:
+  static const size_t SIZE = CT_ASYNC_LOG_QUEUE_SIZE;
+  static_assert((SIZE & (SIZE - 1)) == 0, "CT_ASYNC_LOG_QUEUE_SIZE must be a power of two");
+
+  struct cell {
+    std::atomic<size_t> sequence;
+    log_record record;
+  };
+
+  /// Padding keeps the producers and the consumer on separate cache lines.
+  cell _cells[SIZE];
+  char _pad0[64];
+  std::atomic<size_t> _enqueue;
+  char _pad1[64];
+  size_t _dequeue;
+
+public:
+  queue() : _enqueue(0), _dequeue(0) {
+    for (size_t i = 0; i < SIZE; ++i) {
+      _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /// Returns false when the queue is full.
+  bool push(const log_record& record) {
+    size_t pos = _enqueue.load(std::memory_order_relaxed);
+    for (;;) {
+      cell& c = _cells[pos & (SIZE - 1)];
+      size_t sequence = c.sequence.load(std::memory_order_acquire);
+      if (sequence == pos) {
+        if (_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          c.record = record;
+          c.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if ((ptrdiff_t)(sequence - pos) < 0) {
+        return false;
+      } else {
+        pos = _enqueue.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Only called by the background thread.
+  bool pop(log_record& record) {
+    cell& c = _cells[_dequeue & (SIZE - 1)];
+    if (c.sequence.load(std::memory_order_acquire) != _dequeue + 1) {
+      return false;
+    }
+    record = c.record;
+    c.sequence.store(_dequeue + SIZE, std::memory_order_release);
+    ++_dequeue;
+    return true;
+  }
+};
+
+/// Counts the records of one key in the current second.
+struct rate_window {
+  long long second;
+  unsigned long long count;
+  unsigned long long suppressed;
+};
+
+/**
+ * The background thread. All the state except the queue and the dropped
+ * counter is only touched by it, or under _control while it is not running.
+ */
+class writer {
+private:
+  std::mutex _control;
+  std::thread _thread;
+  std::atomic<bool> _running;
+  options _options;
+  std::FILE* _file;
+  unsigned long long _file_size;
+  unsigned long long _dropped_reported;
+  std::map<const type_descriptor*, rate_window> _types;
+  std::map<std::pair<const char*, unsigned>, rate_window> _sites;
+
+public:
+  queue records;
+  std::atomic<unsigned long long> dropped;
+
+  writer() : _running(false), _file(nullptr), _file_size(0), _dropped_reported(0), dropped(0) {}
+
+  /// Never destroyed, violations may still happen after static destructors ran.
+  static writer* instance() {
+    static writer* w = new writer();
+    return w;
+  }
+
+  /// Set while the logger runs, read by the producers.
+  static std::atomic<writer*>& active() {
+    static std::atomic<writer*> w(nullptr);
+    return w;
+  }
+
+  bool start(const options& opts) {
+    std::lock_guard<std::mutex> lock(_control);
+    if (_running.load()) {
+      return false;
+    }
+    _options = opts;
+    _types.clear();
+    _sites.clear();
+    if (!open()) {
+      return false;
+    }
+    _running.store(true);
+    _thread = std::thread(&writer::run, this);
+    active().store(this, std::memory_order_release);
+    return true;
+  }
+
+  void stop() {
+    std::lock_guard<std::mutex> lock(_control);
+    if (!_running.load()) {
+      return;
+    }
+    active().store(nullptr, std::memory_order_release);
+    _running.store(false);
+    _thread.join();
+    std::fclose(_file);
+    _file = nullptr;
+  }
+
+private:
+  bool open() {
+    _file = std::fopen(_options.path.c_str(), "a");
+    if (_file == nullptr) {
+      return false;
+    }
+    std::fseek(_file, 0, SEEK_END);
+    long size = std::ftell(_file);
+    _file_size = size > 0 ? (unsigned long long)size : 0;
+    return true;
+  }
+
+  /// path.N-1 becomes path.N, ..., path becomes path.1
+  void rotate() {
+    std::fclose(_file);
+    for (unsigned i = _options.max_files; i > 1; --i) {
+      std::rename((_options.path + "." + std::to_string(i - 1)).c_str(),
+                  (_options.path + "." + std::to_string(i)).c_str());
+    }
+    if (_options.max_files > 0) {
+      std::rename(_options.path.c_str(), (_options.path + ".1").c_str());
+    } else {
+      std::remove(_options.path.c_str());
+    }
+    if (!open()) {
+      _file = std::fopen("/dev/null", "w");
+    }
+  }
+
+  void write_line(const std::string& line) {
+    if (_options.max_file_size > 0 && _file_size > 0 &&
+        _file_size + line.size() > _options.max_file_size) {
+      rotate();
+    }
+    std::fwrite(line.data(), 1, line.size(), _file);
+    _file_size += line.size();
+  }
+
+  static std::string bound(long long n, const type_descriptor& type) {
+    return type.is_signed ? std::to_string(n) : std::to_string((unsigned long long)n);
+  }
+
+  static std::string type_name(const type_descriptor& type) {
+    return std::string(type.base_type) + "[" + bound(type.first, type) + ", " + bound(type.last, type) + "]";
+  }
+
+  static std::string site_name(const source_location& where) {
+    return std::string(where.file) + ":" + std::to_string(where.line);
+  }
+
+  /**
+   * Reports the violations suppressed in a second that ended. Records from
+   * several threads may arrive slightly out of order, a late record is counted
+   * in the current window rather than reopening the second it belongs to.
+   */
+  void flush_window(rate_window& window, long long second, const std::string& key) {
+    if (second > window.second) {
+      if (window.suppressed > 0) {
+        write_line("ts=" + std::to_string(window.second) + "000000000 suppressed=" +
+                   std::to_string(window.suppressed) + " " + key + "\n");
+      }
+      window.second = second;
+      window.count = 0;
+      window.suppressed = 0;
+    }
+  }
+
+  static bool admit(rate_window& window, unsigned limit) {
+    return limit == 0 || window.count < limit;
+  }
+
+  void write_record(const log_record& r) {
+    long long second = r.timestamp_ns / 1000000000;
+    const bool located = r.where.file != nullptr;
+    std::pair<const char*, unsigned> site_key(r.where.file, r.where.line);
+
+    rate_window& type_window = _types.insert(std::make_pair(r.type, rate_window())).first->second;
+    flush_window(type_window, second, "type=" + type_name(*r.type));
+    rate_window* site_window = nullptr;
+    if (located) {
+      site_window = &_sites.insert(std::make_pair(site_key, rate_window())).first->second;
+      flush_window(*site_window, second, "at " + site_name(r.where));
+    }
+
+    if (site_window != nullptr && !admit(*site_window, _options.per_site_per_second)) {
+      site_window->suppressed++;
+      return;
+    }
+    if (!admit(type_window, _options.per_type_per_second)) {
+      type_window.suppressed++;
+      return;
+    }
+    type_window.count++;
+    if (site_window != nullptr) {
+      site_window->count++;
+    }
+
+    std::string line = "ts=" + std::to_string(r.timestamp_ns) + " type=" + type_name(*r.type) +
+                       " value=" + bound(r.value, *r.type);
+    if (located) {
+      line += " at " + site_name(r.where);
+    }
+    write_line(line + "\n");
+  }
+
+  /// Reports the windows of all keys, as if their second ended.
+  void flush_all() {
+    for (std::map<const type_descriptor*, rate_window>::iterator i = _types.begin(); i != _types.end(); ++i) {
+      flush_window(i->second, i->second.second + 1, "type=" + type_name(*i->first));
+    }
+    for (std::map<std::pair<const char*, unsigned>, rate_window>::iterator i = _sites.begin();
+         i != _sites.end(); ++i) {
+      source_location where = { i->first.first, i->first.second, nullptr };
+      flush_window(i->second, i->second.second + 1, "at " + site_name(where));
+    }
+  }
+
+  void drain() {
+    log_record r;
+    while (records.pop(r)) {
+      write_record(r);
+    }
+    unsigned long long total = dropped.load(std::memory_order_relaxed);
+    if (total != _dropped_reported) {
+      write_line("dropped=" + std::to_string(total - _dropped_reported) + " queue full\n");
+      _dropped_reported = total;
+    }
+    std::fflush(_file);
+  }
+
+  void run() {
+    while (_running.load()) {
+      drain();
+      std::this_thread::sleep_for(std::chrono::milliseconds(_options.poll_interval_ms));
+    }
+    drain();
+    flush_all();
+    std::fflush(_file);
+  }
+};
+
+inline void stop_at_exit() {
+  writer::instance()->stop();
+}
+
+}
+
+/**
+ * Starts the background thread, appending to opts.path. Returns false when the
+ * logger is already running or the file can not be opened.
+ */
+inline bool start(const options& opts = options()) {
+  static std::once_flag at_exit;
+  std::call_once(at_exit, [] { std::atexit(detail::stop_at_exit); });
+  return detail::writer::instance()->start(opts);
+}
+
+/// Writes the queued records and stops the background thread.
+inline void stop() {
+  detail::writer::instance()->stop();
+}
+
+/// Violations that were not logged because the queue was full.
+inline unsigned long long dropped() {
+  return detail::writer::instance()->dropped.load(std::memory_order_relaxed);
+}
+
+/// Called on the throw path, see on_violation in subtype_range_constrained.h.
+inline void enqueue(const type_descriptor& type, long long value, const source_location& where) {
+  detail::writer* w = detail::writer::active().load(std::memory_order_acquire);
+  if (w == nullptr) {
+    return;
+  }
+  detail::log_record record;
+  record.timestamp_ns = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  record.value = value;
+  record.type = &type;
+  record.where = where;
+  if (!w->records.push(record)) {
+    w->dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+}
+}
+
+#endif
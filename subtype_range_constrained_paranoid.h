@@ -0,0 +1,137 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Checking of the stored value when it is read, to catch memory corruption.
+ *
+ * Enabled by defining CT_PARANOID for the whole program, in which case it is
+ * included by subtype_range_constrained.h. The conversion to the base type
+ * then checks the stored value as well. A value that is out of range there
+ * was not written through the subtype: it was overwritten by a stray write,
+ * copied in by memcpy from C code, or stored by ct::unchecked or an unchecked
+ * policy. Corruption is not recoverable, so the default handler prints the
+ * subtype, the value and the address of the object and aborts:
+ *
+ *   ct corruption: RangeConstrained<short, 1, 12> holds 25443 at 0x7ffc2a1b3e50
+ *
+ * In AddressSanitizer builds it also prints what ASan knows about the address
+ * (the heap block, stack frame or global it belongs to) and the stack trace.
+ * A different handler can be installed with ct::paranoid::set_handler().
+ */
+
+
+#ifndef SUBTYPE_RANGE_CONSTRAINED_PARANOID_H
+#define SUBTYPE_RANGE_CONSTRAINED_PARANOID_H
+
+#include <atomic>
+#include <cstdlib>
+#include <unistd.h>
+#include "subtype_range_constrained_error.h"
+
+#if defined(__SANITIZE_ADDRESS__)
+#  define CT_ASAN 1
+#elif defined(__has_feature)
+#  if __has_feature(address_sanitizer)
+#    define CT_ASAN 1
+#  endif
+#endif
+
+#if defined(CT_ASAN)
+#  include <sanitizer/asan_interface.h>
+#  include <sanitizer/common_interface_defs.h>
+#endif
+
+namespace ConstrainedTypes {
+namespace paranoid {
+
+/// Called with the subtype, the stored value widened as by wide_traits and the address of the object.
+typedef void (*handler)(const type_descriptor& type, long long value, const void* address);
+
+namespace detail {
+
+inline void write_string(const char* str) {
+  ssize_t ignored = write(2, str, __builtin_strlen(str));
+  (void)ignored;
+}
+
+inline void default_handler(const type_descriptor& type, long long value, const void* address) {
+  char line[256];
+  char* end = line + sizeof(line) - 1;
+  char* out = line;
+  out = ConstrainedTypes::detail::append(out, end, "ct corruption: RangeConstrained<");
+  out = ConstrainedTypes::detail::append(out, end, type.base_type);
+  out = ConstrainedTypes::detail::append(out, end, ", ");
+  type_descriptor numeric = type;
+  numeric.is_character = false;
+  out = ConstrainedTypes::detail::append_value(out, end, type.first, numeric);
+  out = ConstrainedTypes::detail::append(out, end, ", ");
+  out = ConstrainedTypes::detail::append_value(out, end, type.last, numeric);
+  out = ConstrainedTypes::detail::append(out, end, "> holds ");
+  out = ConstrainedTypes::detail::append_value(out, end, value, numeric);
+  out = ConstrainedTypes::detail::append(out, end, " at 0x");
+  char digits[16];
+  int count = 0;
+  unsigned long long n = (unsigned long long)(size_t)address;
+  do {
+    digits[count++] = "0123456789abcdef"[n & 0xf];
+    n >>= 4;
+  } while (n != 0);
+  while (count > 0 && out < end) {
+    *out++ = digits[--count];
+  }
+  *out++ = '\n';
+  *out = '\0';
+  write_string(line);
+#if defined(CT_ASAN)
+  __asan_describe_address(const_cast<void*>(address));
+  __sanitizer_print_stack_trace();
+#endif
+}
+
+inline std::atomic<handler>& current_handler() {
+  static std::atomic<handler> h(&default_handler);
+  return h;
+}
+
+}
+
+/// Installs h and returns the previous handler. The program is aborted if h returns.
+inline handler set_handler(handler h) {
+  return detail::current_handler().exchange(h != nullptr ? h : &detail::default_handler);
+}
+
+/// Called when a stored value is out of range, see RangeConstrained::operator T().
+[[noreturn]] CT_COLD inline void corrupted(const type_descriptor& type, long long value, const void* address) {
+  detail::current_handler().load()(type, value, address);
+  std::abort();
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * USDT (SystemTap SDT) static probes for perf, bpftrace and SystemTap.
+ *
+ * Enabled by defining CT_USDT for the whole program, in which case it is
+ * included by subtype_range_constrained.h. The throw path fires the probe
+ * constrained_types:violation with the arguments
+ *
+ *   arg0  base type name  (const char*)
+ *   arg1  value           (long long)
+ *   arg2  first           (long long)
+ *   arg3  last            (long long)
+ *   arg4  file            (const char*, null without CT_SOURCE_LOCATION)
+ *   arg5  line            (unsigned)
+ *
+ * Values of unsigned subtypes are passed as the bits of unsigned long long.
+ * Defining CT_USDT_CHECKS as well adds constrained_types:check with the same
+ * first four arguments to every range check. A probe is a single nop until a
+ * tracer attaches to it, but the check probe keeps its arguments alive, which
+ * costs a few instructions per check.
+ *
+ *   bpftrace -e 'usdt:./app:constrained_types:violation
+ *                { printf("%s %d [%d, %d]\n", str(arg0), arg1, arg2, arg3); }'
+ *
+ * <sys/sdt.h> is used when it is available. Otherwise, on x86-64 and AArch64
+ * ELF targets, the probe notes are emitted by this header in the same format.
+ * On other targets the probes compile to nothing.
+ */
+
+
+#ifndef SUBTYPE_RANGE_CONSTRAINED_PROBES_H
+#define SUBTYPE_RANGE_CONSTRAINED_PROBES_H
+
+#include "subtype_range_constrained_error.h"
+
+#if defined(__has_include)
+#  if __has_include(<sys/sdt.h>)
+#    include <sys/sdt.h>
+#    define CT_PROBE4(name, a0, a1, a2, a3) STAP_PROBE4(constrained_types, name, a0, a1, a2, a3)
+#    define CT_PROBE6(name, a0, a1, a2, a3, a4, a5) \
+       STAP_PROBE6(constrained_types, name, a0, a1, a2, a3, a4, a5)
+#  endif
+#endif
+
+#if !defined(CT_PROBE4) && defined(__GNUC__) && defined(__ELF__) && \
+    (defined(__x86_64__) || defined(__aarch64__))
+
+/*
+ * A note in the .note.stapsdt section, as <sys/sdt.h> writes it: the address
+ * of the nop, the address of the .stapsdt.base section for prelink, no
+ * semaphore, the provider, the probe name and the arguments in the
+ * "size@operand" format, a negative size meaning a signed argument.
+ */
+#  define CT_SDT_PROBE(name, args, ...)                                               \
+     __asm__ __volatile__("990: nop\n"                                                \
+                          ".pushsection .note.stapsdt,\"?\",\"note\"\n"               \
+                          ".balign 4\n"                                               \
+                          ".4byte 992f-991f, 994f-993f, 3\n"                          \
+                          "991: .asciz \"stapsdt\"\n"                                 \
+                          "992: .balign 4\n"                                          \
+                          "993: .8byte 990b\n"                                        \
+                          ".8byte _.stapsdt.base\n"                                   \
+                          ".8byte 0\n"                                                \
+                          ".asciz \"constrained_types\"\n"                            \
+                          ".asciz \"" name "\"\n"                                     \
+                          ".asciz \"" args "\"\n"                                     \
+                          "994: .balign 4\n"                                          \
+                          ".popsection\n"                                             \
+                          ".ifndef _.stapsdt.base\n"                                  \
+                          ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+                          ".weak _.stapsdt.base\n"                                    \
+                          ".hidden _.stapsdt.base\n"                                  \
+                          "_.stapsdt.base: .space 1\n"                                \
+                          ".size _.stapsdt.base, 1\n"                                 \
+                          ".popsection\n"                                             \
+                          ".endif\n"                                                  \
+                          : : __VA_ARGS__)
+
+#  define CT_PROBE4(name, a0, a1, a2, a3)                                             \
+     CT_SDT_PROBE(#name, "8@%0 -8@%1 -8@%2 -8@%3",                                   \
+                  "nor"(a0), "nor"(a1), "nor"(a2), "nor"(a3))
+#  define CT_PROBE6(name, a0, a1, a2, a3, a4, a5)                                     \
+     CT_SDT_PROBE(#name, "8@%0 -8@%1 -8@%2 -8@%3 8@%4 4@%5",                         \
+                  "nor"(a0), "nor"(a1), "nor"(a2), "nor"(a3), "nor"(a4), "nor"(a5))
+#endif
+
+#if !defined(CT_PROBE4)
+#  define CT_PROBE4(name, a0, a1, a2, a3) ((void)0)
+#  define CT_PROBE6(name, a0, a1, a2, a3, a4, a5) ((void)0)
+#endif
+
+namespace ConstrainedTypes {
+namespace probes {
+
+/// Called on the throw path, see on_violation in subtype_range_constrained.h.
+inline void violation(const type_descriptor& type, long long value, const source_location& where) {
+  const char* base_type = type.base_type;
+  long long first = type.first;
+  long long last = type.last;
+  const char* file = where.file;
+  unsigned line = where.line;
+  CT_PROBE6(violation, base_type, value, first, last, file, line);
+  (void)base_type; (void)value; (void)first; (void)last; (void)file; (void)line;
+}
+
+/// Called by every range check when CT_USDT_CHECKS is defined.
+template<class Subtype>
+inline void check(long long value) {
+  typedef decltype(Subtype::first()) T;
+  const char* base_type = detail::base_type_name<T>::value();
+  long long first = detail::wide_traits<T>::widen(Subtype::first());
+  long long last = detail::wide_traits<T>::widen(Subtype::last());
+  CT_PROBE4(check, base_type, value, first, last);
+  (void)base_type; (void)value; (void)first; (void)last;
+}
+
+}
+}
+
+#endif
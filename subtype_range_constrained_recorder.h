@@ -0,0 +1,257 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Flight recorder of the last violations of each thread.
+ *
+ * Enabled by defining CT_FLIGHT_RECORDER for the whole program, in which case
+ * it is included by subtype_range_constrained.h. Before a constraint_error is
+ * thrown, the value, the bounds, the subtype, a timestamp and the address of
+ * the code that performed the check are written into a ring buffer of the
+ * current thread. The ring keeps the last CT_FLIGHT_RECORDER_SIZE records, so
+ * the context of violations that were caught and swallowed is not lost. Only
+ * the throw path writes, the checks themselves are not affected.
+ *
+ * The rings of all threads, including threads that already exited, can be
+ * written to a file descriptor. dump() is async-signal-safe, so it can be
+ * called from a signal handler:
+ *
+ *   void on_fatal_signal(int) { ct::recorder::dump(2); ... }
+ *
+ * or at exit with ct::recorder::dump_at_exit().
+ *
+ * Timestamps are read from the time stamp counter on x86 and from the virtual
+ * counter on AArch64.
+ */
+
+
+#ifndef SUBTYPE_RANGE_CONSTRAINED_RECORDER_H
+#define SUBTYPE_RANGE_CONSTRAINED_RECORDER_H
+
+#include <atomic>
+#include <cstdlib>
+#include <unistd.h>
+#include "subtype_range_constrained_error.h"
+
+#ifndef CT_FLIGHT_RECORDER_SIZE
+#  define CT_FLIGHT_RECORDER_SIZE 64
+#endif
+
+namespace ConstrainedTypes {
+namespace recorder {
+
+/// A single violation.
+struct violation_record {
+  unsigned long long timestamp;
+  long long value;
+  const type_descriptor* type;
+  const void* caller;
+  source_location where;
+};
+
+namespace detail {
+
+inline unsigned long long timestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+  unsigned long long ticks;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Rings are never freed. A ring of an exited thread keeps its records and is
+ * reused by the next thread that records a violation.
+ */
+struct ring {
+  violation_record records[CT_FLIGHT_RECORDER_SIZE];
+  std::atomic<unsigned long long> written;
+  std::atomic<bool> owned;
+  ring* next;
+};
+
+/// Constant initialized, so it can be read from a signal handler at any time.
+inline std::atomic<ring*>& rings() {
+  static std::atomic<ring*> head(nullptr);
+  return head;
+}
+
+inline ring* claim_ring() {
+  for (ring* r = rings().load(std::memory_order_acquire); r != nullptr; r = r->next) {
+    bool expected = false;
+    if (!r->owned.load(std::memory_order_relaxed) &&
+        r->owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      return r;
+    }
+  }
+  ring* r = new ring();
+  r->written.store(0, std::memory_order_relaxed);
+  r->owned.store(true, std::memory_order_relaxed);
+  r->next = rings().load(std::memory_order_relaxed);
+  while (!rings().compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+  return r;
+}
+
+/// Gives the ring back when the thread exits.
+struct thread_ring {
+  ring* r;
+
+  ~thread_ring() {
+    if (r != nullptr) {
+      r->owned.store(false, std::memory_order_release);
+    }
+  }
+};
+
+inline ring& this_thread_ring() {
+  static thread_local thread_ring holder = { nullptr };
+  if (holder.r == nullptr) {
+    holder.r = claim_ring();
+  }
+  return *holder.r;
+}
+
+inline char* append_value(char* out, char* end, long long n, const type_descriptor& type) {
+  if (type.is_signed && n < 0) {
+    out = ConstrainedTypes::detail::append(out, end, "-");
+    return ConstrainedTypes::detail::append_unsigned(out, end, 0ULL - (unsigned long long)n);
+  }
+  return ConstrainedTypes::detail::append_unsigned(out, end, (unsigned long long)n);
+}
+
+inline char* append_hex(char* out, char* end, unsigned long long n) {
+  char digits[16];
+  int count = 0;
+  do {
+    digits[count++] = "0123456789abcdef"[n & 0xf];
+    n >>= 4;
+  } while (n != 0);
+  out = ConstrainedTypes::detail::append(out, end, "0x");
+  while (count > 0 && out < end) {
+    *out++ = digits[--count];
+  }
+  return out;
+}
+
+}
+
+/// Called on the throw path, see on_violation in subtype_range_constrained.h.
+inline void record(const type_descriptor& type, long long value, const void* caller,
+                   const source_location& where) {
+  detail::ring& r = detail::this_thread_ring();
+  unsigned long long n = r.written.load(std::memory_order_relaxed);
+  violation_record& slot = r.records[n % CT_FLIGHT_RECORDER_SIZE];
+  slot.timestamp = detail::timestamp();
+  slot.value = value;
+  slot.type = &type;
+  slot.caller = caller;
+  slot.where = where;
+  r.written.store(n + 1, std::memory_order_release);
+}
+
+/**
+ * Copies up to max records into out and returns how many were copied. Rings
+ * are visited from the most recently created one, records of each ring from
+ * the oldest to the newest.
+ */
+inline size_t collect(violation_record* out, size_t max) {
+  size_t copied = 0;
+  for (detail::ring* r = detail::rings().load(std::memory_order_acquire); r != nullptr; r = r->next) {
+    unsigned long long written = r->written.load(std::memory_order_acquire);
+    unsigned long long n = written < CT_FLIGHT_RECORDER_SIZE ? 0 : written - CT_FLIGHT_RECORDER_SIZE;
+    for (; n < written && copied < max; ++n) {
+      out[copied++] = r->records[n % CT_FLIGHT_RECORDER_SIZE];
+    }
+  }
+  return copied;
+}
+
+/**
+ * Writes the records of all threads to fd, one line per violation:
+ *
+ *   ct violation ts=1234 type=short[1, 12] value=13 caller=0x401a2b
+ *
+ * followed by " at file:line" when the source location is known.
+ *
+ * Async-signal-safe: it does not allocate and only calls write().
+ */
+inline void dump(int fd) {
+  violation_record record;
+  for (detail::ring* r = detail::rings().load(std::memory_order_acquire); r != nullptr; r = r->next) {
+    unsigned long long written = r->written.load(std::memory_order_acquire);
+    unsigned long long n = written < CT_FLIGHT_RECORDER_SIZE ? 0 : written - CT_FLIGHT_RECORDER_SIZE;
+    for (; n < written; ++n) {
+      record = r->records[n % CT_FLIGHT_RECORDER_SIZE];
+      char line[256];
+      char* end = line + sizeof(line) - 1;
+      char* out = line;
+      out = ConstrainedTypes::detail::append(out, end, "ct violation ts=");
+      out = ConstrainedTypes::detail::append_unsigned(out, end, record.timestamp);
+      out = ConstrainedTypes::detail::append(out, end, " type=");
+      out = ConstrainedTypes::detail::append(out, end, record.type->base_type);
+      out = ConstrainedTypes::detail::append(out, end, "[");
+      out = detail::append_value(out, end, record.type->first, *record.type);
+      out = ConstrainedTypes::detail::append(out, end, ", ");
+      out = detail::append_value(out, end, record.type->last, *record.type);
+      out = ConstrainedTypes::detail::append(out, end, "] value=");
+      out = detail::append_value(out, end, record.value, *record.type);
+      out = ConstrainedTypes::detail::append(out, end, " caller=");
+      out = detail::append_hex(out, end, (unsigned long long)(size_t)record.caller);
+      if (record.where.file != nullptr) {
+        out = ConstrainedTypes::detail::append(out, end, " at ");
+        out = ConstrainedTypes::detail::append(out, end, record.where.file);
+        out = ConstrainedTypes::detail::append(out, end, ":");
+        out = ConstrainedTypes::detail::append_unsigned(out, end, record.where.line);
+      }
+      *out++ = '\n';
+      ssize_t ignored = write(fd, line, (size_t)(out - line));
+      (void)ignored;
+    }
+  }
+}
+
+namespace detail {
+inline void dump_to_stderr() {
+  dump(2);
+}
+}
+
+/// Dumps the records to the standard error when the program exits.
+inline void dump_at_exit() {
+  std::atexit(detail::dump_to_stderr);
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,347 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Sampling of the checked values, to choose tighter bounds.
+ *
+ * Enabled by defining CT_SAMPLING for the whole program, in which case it is
+ * included by subtype_range_constrained.h. One in CT_SAMPLING_PERIOD range
+ * checks of each thread (64 by default) records the checked value in the
+ * statistics of its subtype: the smallest and largest values, the values
+ * outside the range, and a histogram of CT_SAMPLING_BUCKETS equal buckets
+ * over the range. The other checks only decrement a per-thread counter.
+ *
+ * The report suggests the smallest bounds that hold all the sampled values
+ * and the number of bits they need:
+ *
+ *   ct::sampling::report(std::cerr);
+ *   // RangeConstrained<int, 0, 1000000> samples=1520 suggested=[3, 997] bits=10 offset_bits=10
+ *   //   [0, 62501) 1520
+ *
+ * Since only some of the values are sampled, the suggested bounds are a lower
+ * limit of the real ones, with a margin that depends on how long the program
+ * ran. As in the telemetry, subtypes are identified by the address of their
+ * descriptor, so subtypes with the same base type and bounds are sampled apart.
+ */
+
+
+#ifndef SUBTYPE_RANGE_CONSTRAINED_SAMPLING_H
+#define SUBTYPE_RANGE_CONSTRAINED_SAMPLING_H
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "subtype_range_constrained_error.h"
+
+#ifndef CT_SAMPLING_PERIOD
+#  define CT_SAMPLING_PERIOD 64
+#endif
+
+#ifndef CT_SAMPLING_BUCKETS
+#  define CT_SAMPLING_BUCKETS 16
+#endif
+
+namespace ConstrainedTypes {
+namespace sampling {
+
+/// Sampled values of one subtype, summed over all the threads.
+struct value_stats {
+  type_descriptor type;
+  unsigned long long samples;
+  long long min;                ///< Meaningless when samples is 0.
+  long long max;
+  unsigned long long below;     ///< Samples smaller than first.
+  unsigned long long above;     ///< Samples larger than last.
+  unsigned long long buckets[CT_SAMPLING_BUCKETS];
+};
+
+/// Bounds that hold all the sampled values.
+struct suggestion {
+  long long first;
+  long long last;
+  unsigned bits;         ///< Bits of the base type representation of the values.
+  unsigned offset_bits;  ///< Bits of value - first.
+};
+
+namespace detail {
+
+/// Written by its thread only, with relaxed stores.
+struct sample_block {
+  std::atomic<unsigned long long> samples;
+  std::atomic<long long> min;
+  std::atomic<long long> max;
+  std::atomic<unsigned long long> below;
+  std::atomic<unsigned long long> above;
+  std::atomic<unsigned long long> buckets[CT_SAMPLING_BUCKETS];
+  const type_descriptor* type;
+  bool in_use;
+};
+
+inline void bump(std::atomic<unsigned long long>& counter) {
+  counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/// Compares wide values as the base type would.
+inline bool less(long long a, long long b, bool is_signed) {
+  return is_signed ? a < b : (unsigned long long)a < (unsigned long long)b;
+}
+
+/// Width of a bucket, the range is split into CT_SAMPLING_BUCKETS buckets of this size.
+inline unsigned long long bucket_width(const type_descriptor& type) {
+  return ((unsigned long long)type.last - (unsigned long long)type.first) / CT_SAMPLING_BUCKETS + 1;
+}
+
+/// Blocks are never freed, those of exited threads are reused. See telemetry::registry.
+class registry {
+private:
+  std::mutex _mutex;
+  std::deque<sample_block> _blocks;
+
+public:
+  static registry& instance() {
+    static registry* r = new registry();
+    return *r;
+  }
+
+  sample_block* acquire(const type_descriptor& type) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+      if (!_blocks[i].in_use && _blocks[i].type == &type) {
+        _blocks[i].in_use = true;
+        return &_blocks[i];
+      }
+    }
+    _blocks.emplace_back();
+    sample_block& block = _blocks.back();
+    block.samples.store(0, std::memory_order_relaxed);
+    block.min.store(0, std::memory_order_relaxed);
+    block.max.store(0, std::memory_order_relaxed);
+    block.below.store(0, std::memory_order_relaxed);
+    block.above.store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < CT_SAMPLING_BUCKETS; ++i) {
+      block.buckets[i].store(0, std::memory_order_relaxed);
+    }
+    block.type = &type;
+    block.in_use = true;
+    return &block;
+  }
+
+  void release(sample_block* block) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    block->in_use = false;
+  }
+
+  std::vector<value_stats> snapshot() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<value_stats> result;
+    std::vector<const type_descriptor*> types;
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+      const sample_block& block = _blocks[i];
+      unsigned long long samples = block.samples.load(std::memory_order_relaxed);
+      if (samples == 0) {
+        continue;
+      }
+      size_t j = 0;
+      while (j < types.size() && types[j] != block.type) {
+        ++j;
+      }
+      long long min = block.min.load(std::memory_order_relaxed);
+      long long max = block.max.load(std::memory_order_relaxed);
+      if (j == result.size()) {
+        value_stats stats = value_stats();
+        stats.type = *block.type;
+        stats.min = min;
+        stats.max = max;
+        result.push_back(stats);
+        types.push_back(block.type);
+      }
+      value_stats& stats = result[j];
+      stats.min = less(min, stats.min, stats.type.is_signed) ? min : stats.min;
+      stats.max = less(stats.max, max, stats.type.is_signed) ? max : stats.max;
+      stats.samples += samples;
+      stats.below += block.below.load(std::memory_order_relaxed);
+      stats.above += block.above.load(std::memory_order_relaxed);
+      for (size_t b = 0; b < CT_SAMPLING_BUCKETS; ++b) {
+        stats.buckets[b] += block.buckets[b].load(std::memory_order_relaxed);
+      }
+    }
+    return result;
+  }
+};
+
+struct thread_blocks {
+  std::vector<sample_block*> blocks;
+
+  ~thread_blocks() {
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      registry::instance().release(blocks[i]);
+    }
+  }
+};
+
+inline thread_blocks& this_thread_blocks() {
+  static thread_local thread_blocks blocks;
+  return blocks;
+}
+
+template<class Subtype>
+struct thread_samples {
+  static thread_local sample_block* block;
+};
+
+template<class Subtype>
+thread_local sample_block* thread_samples<Subtype>::block = nullptr;
+
+/// Shared by all the subtypes, constant initialized so reading it needs no guard.
+inline unsigned& countdown() {
+  static thread_local unsigned n = CT_SAMPLING_PERIOD;
+  return n;
+}
+
+template<class Subtype>
+CT_COLD void sample(long long val) {
+  countdown() = CT_SAMPLING_PERIOD;
+  sample_block* block = thread_samples<Subtype>::block;
+  if (block == nullptr) {
+    block = registry::instance().acquire(Subtype::descriptor());
+    this_thread_blocks().blocks.push_back(block);
+    thread_samples<Subtype>::block = block;
+  }
+
+  const type_descriptor& type = Subtype::descriptor();
+  unsigned long long samples = block->samples.load(std::memory_order_relaxed);
+  if (samples == 0 || less(val, block->min.load(std::memory_order_relaxed), type.is_signed)) {
+    block->min.store(val, std::memory_order_relaxed);
+  }
+  if (samples == 0 || less(block->max.load(std::memory_order_relaxed), val, type.is_signed)) {
+    block->max.store(val, std::memory_order_relaxed);
+  }
+  block->samples.store(samples + 1, std::memory_order_relaxed);
+
+  if (less(val, type.first, type.is_signed)) {
+    bump(block->below);
+  } else if (less(type.last, val, type.is_signed)) {
+    bump(block->above);
+  } else {
+    unsigned long long offset = (unsigned long long)val - (unsigned long long)type.first;
+    bump(block->buckets[offset / bucket_width(type)]);
+  }
+}
+
+/// Number of bits needed to write n in binary.
+inline unsigned significant_bits(unsigned long long n) {
+  unsigned bits = 0;
+  while (n != 0) {
+    ++bits;
+    n >>= 1;
+  }
+  return bits;
+}
+
+inline std::string wide_string(long long n, bool is_signed) {
+  return is_signed ? std::to_string(n) : std::to_string((unsigned long long)n);
+}
+
+}
+
+/// Called by every range check, see on_check in subtype_range_constrained.h.
+template<class Subtype>
+CT_HOT void count_check(long long val) {
+  if (CT_UNLIKELY(--detail::countdown() == 0)) {
+    detail::sample<Subtype>(val);
+  }
+}
+
+/// Statistics of all the subtypes that were sampled so far.
+inline std::vector<value_stats> snapshot() {
+  return detail::registry::instance().snapshot();
+}
+
+/**
+ * The smallest bounds that hold all the sampled values, and the bits needed by
+ * values in these bounds.
+ */
+inline suggestion suggest(const value_stats& stats) {
+  suggestion s;
+  s.first = stats.min;
+  s.last = stats.max;
+  if (stats.type.is_signed && stats.min < 0) {
+    unsigned negative = detail::significant_bits(~(unsigned long long)stats.min);
+    unsigned positive = stats.max < 0 ? 0 : detail::significant_bits((unsigned long long)stats.max);
+    s.bits = 1 + (negative > positive ? negative : positive);
+  } else {
+    s.bits = detail::significant_bits((unsigned long long)stats.max);
+  }
+  s.offset_bits = detail::significant_bits((unsigned long long)stats.max - (unsigned long long)stats.min);
+  s.bits = s.bits == 0 ? 1 : s.bits;
+  return s;
+}
+
+/**
+ * For each sampled subtype, the observed bounds, the bits they need and the
+ * buckets of the histogram that hold any sample:
+ *
+ *   RangeConstrained<int, 0, 1000000> samples=1520 suggested=[3, 997] bits=10 offset_bits=10
+ *     [0, 62501) 1520
+ */
+inline void report(std::ostream& os) {
+  std::vector<value_stats> all = snapshot();
+  for (size_t i = 0; i < all.size(); ++i) {
+    const value_stats& stats = all[i];
+    const bool is_signed = stats.type.is_signed;
+    suggestion s = suggest(stats);
+    os << "RangeConstrained<" << stats.type.base_type << ", "
+       << detail::wide_string(stats.type.first, is_signed) << ", "
+       << detail::wide_string(stats.type.last, is_signed) << "> samples=" << stats.samples
+       << " suggested=[" << detail::wide_string(s.first, is_signed) << ", "
+       << detail::wide_string(s.last, is_signed) << "] bits=" << s.bits
+       << " offset_bits=" << s.offset_bits;
+    if (stats.below + stats.above > 0) {
+      os << " below=" << stats.below << " above=" << stats.above;
+    }
+    os << '\n';
+
+    unsigned long long width = detail::bucket_width(stats.type);
+    for (size_t b = 0; b < CT_SAMPLING_BUCKETS; ++b) {
+      if (stats.buckets[b] == 0) {
+        continue;
+      }
+      unsigned long long from = (unsigned long long)stats.type.first + b * width;
+      os << "  [" << detail::wide_string((long long)from, is_signed) << ", "
+         << detail::wide_string((long long)(from + width), is_signed) << ") " << stats.buckets[b] << '\n';
+    }
+  }
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Violation counts per call site.
+ *
+ * Enabled by defining CT_SOURCE_LOCATION for the whole program, in which case
+ * it is included by subtype_range_constrained.h. The checking constructors and
+ * the compound operators then take the location of their caller as a
+ * defaulted argument. The location is only passed on to the throw path, where
+ * the violation is counted for its file, line and subtype:
+ *
+ *   ct::sites::dump_text(std::cerr);  // orders.cpp:120 handle_order RangeConstrained<short, 1, 12> violations=7
+ *   ct::sites::dump_json(std::cout);
+ *
+ * The increment and decrement operators have no location.
+ */
+
+
+#ifndef SUBTYPE_RANGE_CONSTRAINED_SITES_H
+#define SUBTYPE_RANGE_CONSTRAINED_SITES_H
+
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "subtype_range_constrained_error.h"
+
+namespace ConstrainedTypes {
+namespace sites {
+
+/// Violations of one subtype at one call site.
+struct site_stats {
+  source_location where;
+  const type_descriptor* type;
+  unsigned long long violations;
+};
+
+namespace detail {
+
+inline bool same_string(const char* a, const char* b) {
+  return a == b || (a != nullptr && b != nullptr && std::strcmp(a, b) == 0);
+}
+
+/// Only used on the throw path, so a mutex is cheap enough.
+class registry {
+private:
+  std::mutex _mutex;
+  std::vector<site_stats> _sites;
+
+public:
+  /// Never destroyed, violations may still happen after static destructors ran.
+  static registry& instance() {
+    static registry* r = new registry();
+    return *r;
+  }
+
+  void count(const type_descriptor& type, const source_location& where) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < _sites.size(); ++i) {
+      site_stats& site = _sites[i];
+      if (site.type == &type && site.where.line == where.line && same_string(site.where.file, where.file)) {
+        site.violations++;
+        return;
+      }
+    }
+    site_stats site = { where, &type, 1 };
+    _sites.push_back(site);
+  }
+
+  std::vector<site_stats> snapshot() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _sites;
+  }
+};
+
+inline void append_bound(std::ostream& os, long long n, const type_descriptor& type) {
+  if (type.is_signed) {
+    os << n;
+  } else {
+    os << (unsigned long long)n;
+  }
+}
+
+inline void append_json_string(std::ostream& os, const char* str) {
+  os << '"';
+  for (; str != nullptr && *str; ++str) {
+    if (*str == '"' || *str == '\\') {
+      os << '\\';
+    }
+    os << *str;
+  }
+  os << '"';
+}
+
+}
+
+/// Called on the throw path, see on_violation in subtype_range_constrained.h.
+inline void count_violation(const type_descriptor& type, const source_location& where) {
+  detail::registry::instance().count(type, where);
+}
+
+/// All the call sites that had violations so far, in the order of their first violation.
+inline std::vector<site_stats> snapshot() {
+  return detail::registry::instance().snapshot();
+}
+
+/// One line per call site and subtype: "file:line function RangeConstrained<short, 1, 12> violations=7"
+inline void dump_text(std::ostream& os) {
+  std::vector<site_stats> all = snapshot();
+  for (size_t i = 0; i < all.size(); ++i) {
+    const site_stats& site = all[i];
+    os << (site.where.file ? site.where.file : "?") << ':' << site.where.line << ' '
+       << (site.where.function ? site.where.function : "?") << " RangeConstrained<"
+       << site.type->base_type << ", ";
+    detail::append_bound(os, site.type->first, *site.type);
+    os << ", ";
+    detail::append_bound(os, site.type->last, *site.type);
+    os << "> violations=" << site.violations << '\n';
+  }
+}
+
+/**
+ * A JSON array with an object per call site and subtype:
+ * {"file": "orders.cpp", "line": 120, "function": "handle_order",
+ *  "type": "short", "first": 1, "last": 12, "violations": 7}
+ */
+inline void dump_json(std::ostream& os) {
+  std::vector<site_stats> all = snapshot();
+  os << '[';
+  for (size_t i = 0; i < all.size(); ++i) {
+    const site_stats& site = all[i];
+    os << (i == 0 ? "" : ",") << "\n  {\"file\": ";
+    detail::append_json_string(os, site.where.file);
+    os << ", \"line\": " << site.where.line << ", \"function\": ";
+    detail::append_json_string(os, site.where.function);
+    os << ", \"type\": \"" << site.type->base_type << "\", \"first\": ";
+    detail::append_bound(os, site.type->first, *site.type);
+    os << ", \"last\": ";
+    detail::append_bound(os, site.type->last, *site.type);
+    os << ", \"violations\": " << site.violations << '}';
+  }
+  os << (all.empty() ? "]\n" : "\n]\n");
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,463 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Range checks that are switched on and off at runtime.
+ *
+ * Subtypes with the ct::switchable check policy are not checked until the
+ * checks are switched on, for all of them or per subtype:
+ *
+ *   #include "subtype_range_constrained_switch.h"
+ *   typedef ct::RangeConstrained<int, 0, 4095, ct::switchable> pixel_t;
+ *
+ *   ct::set_checks_enabled(true);            // all the switchable subtypes
+ *   ct::set_checks_enabled<pixel_t>(true);   // only pixel_t
+ *
+ * or by setting CT_CHECKS=on in the environment of the process, which is read
+ * the first time a switch is used.
+ *
+ * Each check site starts as a jump to code that reads a flag. With GCC or
+ * Clang on x86-64 Linux the sites are recorded in the ct_jump_table section,
+ * like the jump labels of the Linux kernel, and enable_check_patching() turns
+ * them into nops. Switching the checks then rewrites the nops into jumps to
+ * the checking code and back, so disabled checks cost a nop. The per subtype
+ * switches are only read while some checks are on. Without a call to
+ * enable_check_patching(), elsewhere, or when the code can not be rewritten
+ * safely, switching only changes the flag.
+ *
+ * The sites are rewritten while other threads may run them, with the sequence
+ * of the kernel's text_poke_bp(): an int3 is written over the first byte of
+ * every site, all the threads are serialized with membarrier(), the other
+ * bytes are written, the threads are serialized again, and the first byte is
+ * written last. A thread that hits an int3 meanwhile is sent on by a SIGTRAP
+ * handler, which hands the traps that are not ours to the previous handler.
+ * Kernels without MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE (before 4.16) are
+ * not patched. All the sites are rewritten or none of them, and each page of
+ * code gets its protection back.
+ *
+ * Only the sites of the executable or the shared object that calls
+ * enable_check_patching() and set_checks_enabled() are rewritten, those
+ * functions are hidden so that each module calls its own. The sites of other
+ * shared objects are never switched, unless they kept reading the flag. A
+ * shared object may still run the sites of a module that switches, when the
+ * dynamic linker resolves an inline function that was not inlined, e.g. at
+ * -O0, to the copy of that module.
+ */
+
+
+#ifndef SUBTYPE_RANGE_CONSTRAINED_SWITCH_H
+#define SUBTYPE_RANGE_CONSTRAINED_SWITCH_H
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include "subtype_range_constrained.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__) && !defined(CT_NO_CODE_PATCHING)
+#  include <algorithm>
+#  include <cstdio>
+#  include <vector>
+#  include <signal.h>
+#  include <ucontext.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#  define CT_CODE_PATCHING 1
+#  define CT_MODULE_LOCAL __attribute__((visibility("hidden")))
+#else
+#  define CT_CODE_PATCHING 0
+#  define CT_MODULE_LOCAL
+#endif
+
+namespace ConstrainedTypes {
+namespace detail {
+
+/// CT_CHECKS=on or CT_CHECKS=1 in the environment.
+inline bool checks_from_environment() {
+  const char* value = std::getenv("CT_CHECKS");
+  return value != nullptr && (std::strcmp(value, "on") == 0 || std::strcmp(value, "1") == 0);
+}
+
+inline std::atomic<bool>& all_checks_enabled() {
+  static std::atomic<bool> enabled(checks_from_environment());
+  return enabled;
+}
+
+/// Whether any check is switched on, read by the sites that were not rewritten.
+inline std::atomic<bool>& any_check_enabled() {
+  static std::atomic<bool> enabled(all_checks_enabled().load());
+  return enabled;
+}
+
+template<class Subtype>
+struct check_switch {
+  static std::atomic<bool> enabled;
+};
+
+template<class Subtype>
+std::atomic<bool> check_switch<Subtype>::enabled(false);
+
+#if CT_CODE_PATCHING
+
+struct jump_entry {
+  unsigned long long code;
+  unsigned long long target;
+  unsigned long long fallback;
+};
+
+extern "C" {
+extern jump_entry __start_ct_jump_table[] __attribute__((weak, visibility("hidden")));
+extern jump_entry __stop_ct_jump_table[] __attribute__((weak, visibility("hidden")));
+}
+
+/// What the sites of a module currently are.
+enum site_mode { SITES_FLAG, SITES_NOP, SITES_JUMP };
+
+/// The mode of the sites of this module.
+CT_MODULE_LOCAL inline site_mode& sites_mode() {
+  static site_mode mode = SITES_FLAG;
+  return mode;
+}
+
+/**
+ * A jump to the flag that enable_check_patching() rewrites into a nop, and
+ * set_checks_enabled() into a jump to the true branch. The table entry is in
+ * the group of the function, so it is discarded along with it.
+ */
+CT_HOT CT_MODULE_LOCAL bool static_branch() {
+  __asm__ goto("1: .byte 0xe9\n"
+               ".long %l[fallback] - . - 4\n"
+               ".pushsection ct_jump_table, \"aw?\"\n"
+               ".balign 8\n"
+               ".quad 1b, %l[enabled], %l[fallback]\n"
+               ".popsection\n"
+               : : : : enabled, fallback);
+  return false;
+enabled:
+  return true;
+fallback:
+  return any_check_enabled().load(std::memory_order_relaxed);
+}
+
+/// Where a site in mode sends the thread that runs it.
+inline unsigned long long destination(const jump_entry& e, site_mode mode) {
+  return mode == SITES_NOP ? e.code + 5 : mode == SITES_JUMP ? e.target : e.fallback;
+}
+
+/// The mode being written, also the one the trap handler sends threads to.
+CT_MODULE_LOCAL inline std::atomic<int>& patching_mode() {
+  static std::atomic<int> mode(SITES_FLAG);
+  return mode;
+}
+
+CT_MODULE_LOCAL inline struct sigaction& previous_trap_action() {
+  static struct sigaction action;
+  return action;
+}
+
+/**
+ * Sends a thread that hit the int3 of a site being rewritten to where the
+ * site now leads. Other traps go to the handler that was installed before.
+ */
+CT_MODULE_LOCAL inline void on_site_trap(int sig, siginfo_t* info, void* context) {
+  ucontext_t* uc = static_cast<ucontext_t*>(context);
+  const unsigned long long at = (unsigned long long)uc->uc_mcontext.gregs[REG_RIP] - 1;
+  for (jump_entry* e = __start_ct_jump_table; e != __stop_ct_jump_table; ++e) {
+    if (e->code == at) {
+      uc->uc_mcontext.gregs[REG_RIP] =
+          (greg_t)destination(*e, (site_mode)patching_mode().load(std::memory_order_acquire));
+      return;
+    }
+  }
+  struct sigaction& previous = previous_trap_action();
+  if ((previous.sa_flags & SA_SIGINFO) != 0) {
+    previous.sa_sigaction(sig, info, context);
+  } else if (previous.sa_handler == SIG_DFL) {
+    sigaction(SIGTRAP, &previous, nullptr);
+    raise(SIGTRAP);
+  } else if (previous.sa_handler != SIG_IGN) {
+    previous.sa_handler(sig);
+  }
+}
+
+/// Installs on_site_trap() unless it is already the SIGTRAP handler.
+CT_MODULE_LOCAL inline bool install_trap_handler() {
+  struct sigaction current;
+  if (sigaction(SIGTRAP, nullptr, &current) != 0) {
+    return false;
+  }
+  if ((current.sa_flags & SA_SIGINFO) != 0 && current.sa_sigaction == &on_site_trap) {
+    return true;
+  }
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_sigaction = &on_site_trap;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  previous_trap_action() = current;
+  return sigaction(SIGTRAP, &action, nullptr) == 0;
+}
+
+/// membarrier() commands, from <linux/membarrier.h>.
+enum {
+  MEMBARRIER_SYNC_CORE = 1 << 5,
+  MEMBARRIER_REGISTER_SYNC_CORE = 1 << 6
+};
+
+/// Makes every thread of the process, the caller included, execute a serializing instruction.
+inline bool sync_cores() {
+  if (syscall(__NR_membarrier, MEMBARRIER_SYNC_CORE, 0) != 0) {
+    return false;
+  }
+  unsigned a = 0, b, c = 0, d;
+  __asm__ __volatile__("cpuid" : "+a"(a), "=b"(b), "+c"(c), "=d"(d) : : "memory");
+  return true;
+}
+
+/// A page of code and its protection before it was made writable.
+struct code_page {
+  unsigned long long start;
+  int protection;
+};
+
+/// Reads the protection of each page from /proc/self/maps, false when it can not.
+inline bool read_protections(std::vector<code_page>& pages) {
+  std::FILE* maps = std::fopen("/proc/self/maps", "r");
+  if (maps == nullptr) {
+    return false;
+  }
+  size_t found = 0;
+  unsigned long long from, to;
+  char perms[5];
+  while (found < pages.size() && std::fscanf(maps, "%llx-%llx %4s %*[^\n]", &from, &to, perms) == 3) {
+    for (size_t i = 0; i < pages.size(); ++i) {
+      if (pages[i].start >= from && pages[i].start < to) {
+        pages[i].protection = (perms[0] == 'r' ? PROT_READ : 0) | (perms[1] == 'w' ? PROT_WRITE : 0) |
+                              (perms[2] == 'x' ? PROT_EXEC : 0);
+        ++found;
+      }
+    }
+  }
+  std::fclose(maps);
+  return found == pages.size();
+}
+
+/**
+ * The pages that hold the sites of this module, with the protection they had
+ * when they were first rewritten. Empty when there are none, or when their
+ * protection could not be read. A site may span two pages.
+ */
+CT_MODULE_LOCAL inline const std::vector<code_page>& site_pages(unsigned long long page) {
+  static std::vector<code_page> pages;
+  static bool read = false;
+  if (!read) {
+    read = true;
+    for (jump_entry* e = __start_ct_jump_table; e != __stop_ct_jump_table; ++e) {
+      code_page first = { e->code & ~(page - 1), 0 };
+      code_page last = { (e->code + 4) & ~(page - 1), 0 };
+      pages.push_back(first);
+      pages.push_back(last);
+    }
+    std::sort(pages.begin(), pages.end(),
+              [](const code_page& a, const code_page& b) { return a.start < b.start; });
+    pages.erase(std::unique(pages.begin(), pages.end(),
+                            [](const code_page& a, const code_page& b) { return a.start == b.start; }),
+                pages.end());
+    if (!read_protections(pages)) {
+      pages.clear();
+    }
+  }
+  return pages;
+}
+
+/**
+ * Rewrites all the sites of this module into mode, or none of them when the
+ * code can not be made writable, and returns whether it did. Only the pages
+ * that hold sites are made writable, and they get their protection back.
+ */
+CT_MODULE_LOCAL inline bool patch_sites(site_mode mode) {
+  const unsigned long long page = (unsigned long long)sysconf(_SC_PAGESIZE);
+  const std::vector<code_page>& pages = site_pages(page);
+  if (pages.empty() || !install_trap_handler()) {
+    return false;
+  }
+  for (size_t i = 0; i < pages.size(); ++i) {
+    if (mprotect((void*)pages[i].start, page, PROT_READ | PROT_WRITE | PROT_EXEC) != 0) {
+      while (i-- > 0) {
+        mprotect((void*)pages[i].start, page, pages[i].protection);
+      }
+      return false;
+    }
+  }
+
+  patching_mode().store(mode, std::memory_order_release);
+  bool synced = sync_cores();
+  if (synced) {
+    for (jump_entry* e = __start_ct_jump_table; e != __stop_ct_jump_table; ++e) {
+      *(volatile unsigned char*)e->code = 0xcc;
+    }
+    sync_cores();
+    unsigned char insn[5] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+    for (jump_entry* e = __start_ct_jump_table; e != __stop_ct_jump_table; ++e) {
+      if (mode != SITES_NOP) {
+        int offset = (int)(long long)(destination(*e, mode) - (e->code + 5));
+        insn[0] = 0xe9;
+        std::memcpy(insn + 1, &offset, 4);
+      }
+      for (int i = 1; i < 5; ++i) {
+        ((volatile unsigned char*)e->code)[i] = insn[i];
+      }
+    }
+    sync_cores();
+    for (jump_entry* e = __start_ct_jump_table; e != __stop_ct_jump_table; ++e) {
+      *(volatile unsigned char*)e->code = mode == SITES_NOP ? 0x0f : 0xe9;
+    }
+    sync_cores();
+  }
+
+  for (size_t i = 0; i < pages.size(); ++i) {
+    mprotect((void*)pages[i].start, page, pages[i].protection);
+  }
+  return synced;
+}
+
+#else
+
+CT_HOT bool static_branch() {
+  return any_check_enabled().load(std::memory_order_relaxed);
+}
+
+#endif
+
+inline std::mutex& switch_mutex() {
+  static std::mutex m;
+  return m;
+}
+
+/// Number of subtypes switched on by set_checks_enabled<Subtype>().
+inline unsigned& subtypes_enabled() {
+  static unsigned n = 0;
+  return n;
+}
+
+/// Called with switch_mutex held, after a switch changed.
+CT_MODULE_LOCAL inline bool update_sites() {
+  const bool any = all_checks_enabled().load() || subtypes_enabled() > 0;
+#if CT_CODE_PATCHING
+  const site_mode mode = any ? SITES_JUMP : SITES_NOP;
+  if (sites_mode() != SITES_FLAG && sites_mode() != mode) {
+    if (!patch_sites(mode)) {
+      return false;
+    }
+    sites_mode() = mode;
+  }
+#endif
+  any_check_enabled().store(any);
+  return true;
+}
+
+}
+
+/**
+ * Check policy of subtypes that are checked only while their checks are
+ * switched on, see set_checks_enabled(). Like with ct::sampled, values that are
+ * not checked are assumed to be in range.
+ */
+struct switchable {
+  template<class Subtype>
+  CT_HOT static bool check() {
+    return detail::static_branch() &&
+           (detail::all_checks_enabled().load(std::memory_order_relaxed) ||
+            detail::check_switch<Subtype>::enabled.load(std::memory_order_relaxed));
+  }
+};
+
+/**
+ * Rewrites the check sites of the calling executable or shared object into
+ * nops, or jumps when checks are on, so that disabled checks no longer read a
+ * flag. Returns false when the code can not be rewritten safely, the sites
+ * keep reading the flag then. Call it once, e.g. at the start of main().
+ */
+CT_MODULE_LOCAL inline bool enable_check_patching() {
+#if CT_CODE_PATCHING
+  std::lock_guard<std::mutex> lock(detail::switch_mutex());
+  if (detail::sites_mode() == detail::SITES_FLAG) {
+    if (syscall(__NR_membarrier, detail::MEMBARRIER_REGISTER_SYNC_CORE, 0) != 0) {
+      return false;
+    }
+    const detail::site_mode mode = detail::any_check_enabled().load() ? detail::SITES_JUMP : detail::SITES_NOP;
+    if (!detail::patch_sites(mode)) {
+      return false;
+    }
+    detail::sites_mode() = mode;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * Switches the checks of all the switchable subtypes on or off. Returns false
+ * when the code could not be rewritten, the checks are left unchanged then.
+ */
+CT_MODULE_LOCAL inline bool set_checks_enabled(bool enabled) {
+  std::lock_guard<std::mutex> lock(detail::switch_mutex());
+  const bool previous = detail::all_checks_enabled().exchange(enabled);
+  if (!detail::update_sites()) {
+    detail::all_checks_enabled().store(previous);
+    return false;
+  }
+  return true;
+}
+
+/// Switches the checks of a single switchable subtype on or off.
+template<class Subtype>
+CT_MODULE_LOCAL bool set_checks_enabled(bool enabled) {
+  std::lock_guard<std::mutex> lock(detail::switch_mutex());
+  const bool previous = detail::check_switch<Subtype>::enabled.exchange(enabled);
+  if (previous != enabled) {
+    detail::subtypes_enabled() += enabled ? 1 : -1;
+    if (!detail::update_sites()) {
+      detail::subtypes_enabled() += enabled ? -1 : 1;
+      detail::check_switch<Subtype>::enabled.store(previous);
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Whether the checks of all the switchable subtypes are switched on.
+inline bool checks_enabled() {
+  return detail::all_checks_enabled().load();
+}
+
+}
+
+#endif
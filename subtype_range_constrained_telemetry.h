@@ -0,0 +1,270 @@
+/**
+ * @author  Artium Nihamkin <artium@nihamkin.com>
+ * @date May 2014
+ *
+ * @section LICENSE
+ *
+ * The MIT License (MIT)
+ * Copyright © 2014 Artium Nihamkin, http://nihamkin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Per subtype counters of range checks and violations.
+ *
+ * Enabled by defining CT_TELEMETRY for the whole program, in which case it is
+ * included by subtype_range_constrained.h. Every range check increments a
+ * counter that belongs to the current thread and subtype. Only the owning
+ * thread writes a counter, so the increment is a plain load and store without
+ * a locked instruction. The registry sums the counters of all threads when a
+ * snapshot or a dump is requested:
+ *
+ *   ct::telemetry::dump_text(std::cerr);
+ *   ct::telemetry::dump_json(std::cout);
+ *
+ * Subtypes are identified by the address of their descriptor, see
+ * RangeConstrained::descriptor(). Subtypes with the same base type and bounds,
+ * such as two enumerations or two policies, are counted apart. A subtype used
+ * from several shared objects is reported once, as long as the dynamic linker
+ * merges its descriptor (the default for ELF symbols that are not hidden).
+ */
+
+
+#ifndef SUBTYPE_RANGE_CONSTRAINED_TELEMETRY_H
+#define SUBTYPE_RANGE_CONSTRAINED_TELEMETRY_H
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "subtype_range_constrained_error.h"
+
+namespace ConstrainedTypes {
+namespace telemetry {
+
+/// Counts of one subtype, summed over all the threads.
+struct type_stats {
+  type_descriptor type;
+  unsigned long long checks;
+  unsigned long long violations;
+};
+
+namespace detail {
+
+struct counter_block {
+  std::atomic<unsigned long long> checks;
+  std::atomic<unsigned long long> violations;
+  const type_descriptor* type;
+  bool in_use;
+};
+
+/// The owning thread is the only writer, so there is no need for a locked increment.
+inline void bump(std::atomic<unsigned long long>& counter) {
+  counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/**
+ * Owns the counter blocks of all the threads. Blocks are never freed: when a
+ * thread exits its blocks are released and reused by the next thread that
+ * checks the same subtype, which keeps the totals and bounds the memory.
+ */
+class registry {
+private:
+  std::mutex _mutex;
+  std::deque<counter_block> _blocks;
+
+public:
+  /// Never destroyed, threads may still exit after static destructors ran.
+  static registry& instance() {
+    static registry* r = new registry();
+    return *r;
+  }
+
+  counter_block* acquire(const type_descriptor& type) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+      if (!_blocks[i].in_use && _blocks[i].type == &type) {
+        _blocks[i].in_use = true;
+        return &_blocks[i];
+      }
+    }
+    _blocks.emplace_back();
+    counter_block& block = _blocks.back();
+    block.checks.store(0, std::memory_order_relaxed);
+    block.violations.store(0, std::memory_order_relaxed);
+    block.type = &type;
+    block.in_use = true;
+    return &block;
+  }
+
+  void release(counter_block* block) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    block->in_use = false;
+  }
+
+  std::vector<type_stats> snapshot() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<type_stats> result;
+    std::vector<const type_descriptor*> types;
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+      const counter_block& block = _blocks[i];
+      size_t j = 0;
+      while (j < types.size() && types[j] != block.type) {
+        ++j;
+      }
+      if (j == types.size()) {
+        type_stats stats = { *block.type, 0, 0 };
+        result.push_back(stats);
+        types.push_back(block.type);
+      }
+      result[j].checks += block.checks.load(std::memory_order_relaxed);
+      result[j].violations += block.violations.load(std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+  /// Counts of the blocks of type, summed over all the threads.
+  type_stats stats_of(const type_descriptor& type) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    type_stats stats = { type, 0, 0 };
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+      if (_blocks[i].type == &type) {
+        stats.checks += _blocks[i].checks.load(std::memory_order_relaxed);
+        stats.violations += _blocks[i].violations.load(std::memory_order_relaxed);
+      }
+    }
+    return stats;
+  }
+};
+
+/// Releases the blocks of a thread when it exits.
+struct thread_blocks {
+  std::vector<counter_block*> blocks;
+
+  ~thread_blocks() {
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      registry::instance().release(blocks[i]);
+    }
+  }
+};
+
+inline thread_blocks& this_thread_blocks() {
+  static thread_local thread_blocks blocks;
+  return blocks;
+}
+
+template<class Subtype>
+struct thread_counters {
+  static thread_local counter_block* block;
+};
+
+template<class Subtype>
+thread_local counter_block* thread_counters<Subtype>::block = nullptr;
+
+/// First check of Subtype by the current thread.
+template<class Subtype>
+CT_COLD counter_block* attach() {
+  counter_block* block = registry::instance().acquire(Subtype::descriptor());
+  this_thread_blocks().blocks.push_back(block);
+  thread_counters<Subtype>::block = block;
+  return block;
+}
+
+template<class Subtype>
+CT_HOT counter_block& counters() {
+  counter_block* block = thread_counters<Subtype>::block;
+  if (CT_UNLIKELY(block == nullptr)) {
+    block = attach<Subtype>();
+  }
+  return *block;
+}
+
+inline void append_bound(std::string& out, long long n, const type_descriptor& type) {
+  out += type.is_signed ? std::to_string(n) : std::to_string((unsigned long long)n);
+}
+
+}
+
+template<class Subtype>
+CT_HOT void count_check() {
+  detail::bump(detail::counters<Subtype>().checks);
+}
+
+template<class Subtype>
+inline void count_violation() {
+  detail::bump(detail::counters<Subtype>().violations);
+}
+
+/// Counts of all the subtypes that were checked so far.
+inline std::vector<type_stats> snapshot() {
+  return detail::registry::instance().snapshot();
+}
+
+/// Counts of a single subtype, zero if it was never checked.
+template<class Subtype>
+type_stats stats_of() {
+  return detail::registry::instance().stats_of(Subtype::descriptor());
+}
+
+/// "RangeConstrained<short, 1, 12>"
+inline std::string type_name(const type_descriptor& type) {
+  std::string name = "RangeConstrained<";
+  name += type.base_type;
+  name += ", ";
+  detail::append_bound(name, type.first, type);
+  name += ", ";
+  detail::append_bound(name, type.last, type);
+  name += ">";
+  return name;
+}
+
+/// One line per subtype: "RangeConstrained<short, 1, 12> checks=120 violations=3"
+inline void dump_text(std::ostream& os) {
+  std::vector<type_stats> all = snapshot();
+  for (size_t i = 0; i < all.size(); ++i) {
+    os << type_name(all[i].type) << " checks=" << all[i].checks
+       << " violations=" << all[i].violations << '\n';
+  }
+}
+
+/**
+ * A JSON array with an object per subtype:
+ * {"type": "short", "first": 1, "last": 12, "checks": 120, "violations": 3}
+ */
+inline void dump_json(std::ostream& os) {
+  std::vector<type_stats> all = snapshot();
+  os << '[';
+  for (size_t i = 0; i < all.size(); ++i) {
+    std::string first, last;
+    detail::append_bound(first, all[i].type.first, all[i].type);
+    detail::append_bound(last, all[i].type.last, all[i].type);
+    os << (i == 0 ? "" : ",") << "\n  {\"type\": \"" << all[i].type.base_type
+       << "\", \"first\": " << first << ", \"last\": " << last
+       << ", \"checks\": " << all[i].checks << ", \"violations\": " << all[i].violations << '}';
+  }
+  os << (all.empty() ? "]\n" : "\n]\n");
+}
+
+}
+}
+
+#endif
@@ -33,7 +33,16 @@
  */
 
 #include "subtype_range_constrained.h"
+#include "subtype_range_constrained_switch.h"
+#include "subtype_range_constrained_bulk.h"
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
 #include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
 #include <vector>
 #include <stdexcept>
 
@@ -70,6 +79,14 @@ month_t f4(month_t x) {
   return x;
 }
 
+#if defined(__cpp_consteval)
+CT_DEFINE_LITERAL(month_t, _month)
+
+/* True when month_t::of(V) is a constant expression, i.e. V was accepted at compile time */
+template <short V>
+concept constant_month = requires { typename std::integral_constant<short, month_t::of(V)>; };
+#endif
+
 /////////////////////////////////////////////////
 ///                                           ///
 /// Test cases start here                     ///
@@ -683,3 +700,1324 @@ TEST_CASE("big range_size") {
     CHECK(ct::RangeConstrained<int64_t, numeric_limits<int64_t>::min(), numeric_limits<int64_t>::max()>::range_size() == 0xffffffffffffffff + 1);
   }
 }
+
+TEST_CASE("exception message") {
+  SECTION("signed") {
+    try {
+      ct::RangeConstrained<int, -100, 100> x = -101;
+      FAIL("no exception was thrown for " << x);
+    } catch (const ct::RangeConstrained<int, -100, 100>::constraint_error& e) {
+      CHECK(string(e.what()) == "The value -101 is out of the range [-100, 100]");
+      CHECK(e.getVal() == -101);
+      CHECK(e.getFirst() == -100);
+      CHECK(e.getLast() == 100);
+    }
+  }
+
+  SECTION("64 bit extremes") {
+    try {
+      ct::RangeConstrained<int64_t, 0, numeric_limits<int64_t>::max()> x = numeric_limits<int64_t>::min();
+      FAIL("no exception was thrown for " << x);
+    } catch (const std::exception& e) {
+      CHECK(string(e.what()) ==
+            "The value -9223372036854775808 is out of the range [0, 9223372036854775807]");
+    }
+  }
+
+  SECTION("char is printed as a character") {
+    try {
+      ct::RangeConstrained<char, 'a', 'z'> ch = '%';
+      FAIL("no exception was thrown for " << ch);
+    } catch (const std::exception& e) {
+      CHECK(string(e.what()) == "The value % is out of the range [a, z]");
+    }
+  }
+
+  SECTION("enum") {
+    CHECK_THROWS_WITH((ct::RangeConstrained<enum E, B, D>(E)), "The value 4 is out of the range [1, 3]");
+  }
+}
+
+TEST_CASE("common base of constraint errors") {
+  typedef ct::RangeConstrained<uint64_t, 10, numeric_limits<uint64_t>::max() - 1> big_t;
+  typedef ct::RangeConstrained<char, 'a', 'z'> lower_alpha_t;
+
+  SECTION("a single handler catches the errors of all subtypes") {
+    int caught = 0;
+    try { month_t m = 13; (void)m; } catch (const ct::constraint_error_base&) { caught++; }
+    try { lower_alpha_t ch = '%'; (void)ch; } catch (const ct::constraint_error_base&) { caught++; }
+    try { big_t b = 1; (void)b; } catch (const ct::constraint_error_base&) { caught++; }
+    CHECK(caught == 3);
+  }
+
+#if !defined(CT_LIGHT_EXCEPTIONS)
+  SECTION("handlers of std::out_of_range still catch them") {
+    try {
+      month_t m = 13;
+      FAIL("no exception was thrown for " << m);
+    } catch (const std::out_of_range& e) {
+      CHECK(string(e.what()) == "The value 13 is out of the range [1, 12]");
+    }
+    CHECK_THROWS_AS((lower_alpha_t('%')), std::logic_error);
+  }
+#endif
+
+  SECTION("wide values and descriptor") {
+    try {
+      month_t m = -3;
+      FAIL("no exception was thrown for " << m);
+    } catch (const ct::constraint_error_base& e) {
+      CHECK(e.getWideVal() == -3);
+      CHECK(e.getWideFirst() == 1);
+      CHECK(e.getWideLast() == 12);
+      CHECK(&e.descriptor() == &month_t::descriptor());
+      CHECK(string(e.descriptor().base_type) == "short");
+      CHECK(e.descriptor().size == sizeof(short));
+      CHECK(e.descriptor().is_signed);
+    }
+  }
+
+  SECTION("unsigned 64 bit values are kept bit exact") {
+    try {
+      big_t b = numeric_limits<uint64_t>::max();
+      FAIL("no exception was thrown for " << b);
+    } catch (const big_t::constraint_error& e) {
+      CHECK(e.getVal() == numeric_limits<uint64_t>::max());
+      CHECK((unsigned long long)e.getWideLast() == numeric_limits<uint64_t>::max() - 1);
+      CHECK_FALSE(e.descriptor().is_signed);
+      CHECK(string(e.what()) ==
+            "The value 18446744073709551615 is out of the range [10, 18446744073709551614]");
+    }
+  }
+
+  SECTION("descriptors identify subtypes") {
+    CHECK(&month_t::descriptor() != &ct::RangeConstrained<short, 1, 11>::descriptor());
+    CHECK(string(ct::RangeConstrained<enum E, B, D>::descriptor().base_type) == "enum");
+  }
+
+  SECTION("subtypes of a base type share their error class") {
+    typedef ct::RangeConstrained<short, 1, 31> day_t;
+    CHECK((std::is_same<month_t::constraint_error, day_t::constraint_error>::value));
+    try {
+      day_t d = 32;
+      FAIL("no exception was thrown for " << d);
+    } catch (const month_t::constraint_error& e) {
+      CHECK(e.getVal() == 32);
+      CHECK(&e.descriptor() == &day_t::descriptor());
+    }
+  }
+}
+
+TEST_CASE("compile time checking of constants") {
+  SECTION("of<Value>") {
+    month_t m = month_t::of<12>();
+    CHECK(m == 12);
+    m = month_t::of<1>();
+    CHECK(m == 1);
+    /* month_t::of<13>() does not compile */
+  }
+
+  SECTION("constexpr construction") {
+    constexpr month_t m = 7;
+    static_assert(m == 7, "constexpr construction");
+    static_assert(month_t::first() == 1 && month_t::last() == 12, "constexpr bounds");
+    /* constexpr month_t bad = 13; does not compile */
+  }
+
+  SECTION("unchecked construction") {
+    month_t m(ct::unchecked, 3);
+    CHECK(m == 3);
+  }
+
+#if defined(__cpp_consteval)
+  SECTION("consteval of() and literals") {
+    month_t m = month_t::of(12);
+    CHECK(m == 12);
+    m = 11_month;
+    CHECK(m == 11);
+
+    static_assert(constant_month<1>, "in range constant");
+    static_assert(constant_month<12>, "in range constant");
+    static_assert(!constant_month<0>, "out of range constant");
+    static_assert(!constant_month<13>, "out of range constant");
+    /* m = 13_month; does not compile */
+  }
+#endif
+
+  SECTION("runtime values are still checked") {
+    CHECK_THROWS_AS(month_t(f1(13)), month_t::constraint_error);
+  }
+}
+
+TEST_CASE("sampled checking") {
+  typedef ct::RangeConstrained<int, 0, 99, ct::sampled<4>> sampled_t;
+  typedef ct::RangeConstrained<int, 0, 98, ct::sampled<0>> thread_sampled_t;
+
+  /* The policy is part of the type but not of its interface */
+  CHECK(sampled_t::first() == 0);
+  CHECK(sampled_t::last() == 99);
+  CHECK(sizeof(sampled_t) == sizeof(int));
+
+  /* The first value stored in each thread is checked */
+  CHECK_THROWS_AS(sampled_t(f1(100)), sampled_t::constraint_error);
+
+  sampled_t s = 10;
+  for (int i = 0; i < 40; ++i) {
+    s = i;
+    s += 1;
+  }
+  CHECK(s == 40);
+
+  /* Constants are always checked */
+  CHECK(sampled_t::of<99>() == 99);
+
+  std::thread other([] {
+    ct::set_check_period(2);
+    CHECK_THROWS_AS(thread_sampled_t(f1(-1)), thread_sampled_t::constraint_error);
+  });
+  other.join();
+
+#if defined(CT_TELEMETRY)
+  SECTION("one in Period values is checked") {
+    typedef ct::RangeConstrained<int, 0, 97, ct::sampled<4>> counted_t;
+    for (int i = 0; i < 40; ++i) {
+      counted_t c = i;
+      (void)c;
+    }
+    CHECK(ct::telemetry::stats_of<counted_t>().checks == 10);
+
+    std::thread counter([] {
+      ct::set_check_period(5);
+      for (int i = 0; i < 40; ++i) {
+        thread_sampled_t c = i;
+        (void)c;
+      }
+    });
+    counter.join();
+    /* One check in the first thread, the first value and one in 5 after it in the second */
+    CHECK(ct::telemetry::stats_of<thread_sampled_t>().checks == 1 + 8);
+  }
+#endif
+}
+
+TEST_CASE("switchable checking") {
+  typedef ct::RangeConstrained<int, 0, 99, ct::switchable> switched_t;
+  typedef ct::RangeConstrained<int, 0, 98, ct::switchable> other_t;
+
+  CHECK_FALSE(ct::checks_enabled());
+  switched_t s = 5;
+  CHECK(s == 5);
+
+  SECTION("all subtypes") {
+    REQUIRE(ct::set_checks_enabled(true));
+    CHECK(ct::checks_enabled());
+    CHECK_THROWS_AS(switched_t(f1(100)), switched_t::constraint_error);
+    CHECK_THROWS_AS(other_t(f1(99)), other_t::constraint_error);
+    CHECK_THROWS_AS(s += 95, switched_t::constraint_error);
+    CHECK(s == 5);
+    REQUIRE(ct::set_checks_enabled(false));
+    CHECK_FALSE(ct::checks_enabled());
+  }
+
+  SECTION("single subtype") {
+    REQUIRE(ct::set_checks_enabled<switched_t>(true));
+    CHECK_FALSE(ct::checks_enabled());
+    CHECK_THROWS_AS(switched_t(f1(100)), switched_t::constraint_error);
+    CHECK_NOTHROW(other_t(f1(98)));
+    REQUIRE(ct::set_checks_enabled<switched_t>(false));
+  }
+
+#if CT_CODE_PATCHING
+  SECTION("sites are nops while the checks are off") {
+    REQUIRE(ct::enable_check_patching());
+    CHECK(ct::detail::sites_mode() == ct::detail::SITES_NOP);
+    REQUIRE(ct::set_checks_enabled(true));
+    CHECK(ct::detail::sites_mode() == ct::detail::SITES_JUMP);
+    CHECK_THROWS_AS(switched_t(f1(100)), switched_t::constraint_error);
+    REQUIRE(ct::set_checks_enabled(false));
+    CHECK(ct::detail::sites_mode() == ct::detail::SITES_NOP);
+  }
+#endif
+
+  SECTION("switching while other threads check") {
+    ct::enable_check_patching();
+    std::atomic<bool> done(false);
+    std::atomic<unsigned long long> checked(0);
+    vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&done, &checked] {
+        for (int i = 0; !done.load(std::memory_order_relaxed); ++i) {
+          switched_t v = f1(i % 100);
+          checked.fetch_add(v == i % 100, std::memory_order_relaxed);
+        }
+      });
+    }
+    while (checked.load() < 10000) {
+      std::this_thread::yield();
+    }
+    for (int i = 0; i < 200; ++i) {
+      CHECK(ct::set_checks_enabled(i % 2 == 0));
+    }
+    CHECK(ct::set_checks_enabled(false));
+    done = true;
+    for (std::thread& t : threads) {
+      t.join();
+    }
+    CHECK(checked > 0);
+  }
+
+#if defined(CT_TELEMETRY)
+  SECTION("disabled checks are not made") {
+    unsigned long long before = ct::telemetry::stats_of<other_t>().checks;
+    for (int i = 0; i < 10; ++i) {
+      other_t o = i;
+      (void)o;
+    }
+    CHECK(ct::telemetry::stats_of<other_t>().checks == before);
+    REQUIRE(ct::set_checks_enabled<other_t>(true));
+    other_t o = 1;
+    (void)o;
+    CHECK(ct::telemetry::stats_of<other_t>().checks == before + 1);
+    REQUIRE(ct::set_checks_enabled<other_t>(false));
+  }
+#endif
+}
+
+#if defined(CT_TELEMETRY)
+TEST_CASE("telemetry counters") {
+  typedef ct::RangeConstrained<int, -7, 7> counted_t;
+
+  ct::telemetry::type_stats before = ct::telemetry::stats_of<counted_t>();
+  counted_t x = 0;
+  x += 3;
+  CHECK_THROWS(x = 8);
+  CHECK_THROWS(x += 5);
+
+  ct::telemetry::type_stats after = ct::telemetry::stats_of<counted_t>();
+  CHECK(after.checks - before.checks == 4);
+  CHECK(after.violations - before.violations == 2);
+
+  SECTION("counters of all threads are summed") {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.push_back(std::thread([] {
+        for (int i = 0; i < 1000; ++i) {
+          counted_t y = i % 8;
+          (void)y;
+        }
+        try { counted_t z = 100; (void)z; } catch (const ct::constraint_error_base&) {}
+      }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+      threads[t].join();
+    }
+
+    ct::telemetry::type_stats total = ct::telemetry::stats_of<counted_t>();
+    CHECK(total.checks - after.checks == 4 * 1001);
+    CHECK(total.violations - after.violations == 4);
+  }
+
+  SECTION("subtypes with the same bounds are counted apart") {
+    enum signal { STOP, GO };
+    typedef ct::RangeConstrained<enum E, A, B> letter_t;
+    typedef ct::RangeConstrained<signal, STOP, GO> signal_t;
+    const unsigned long long letters = ct::telemetry::stats_of<letter_t>().checks;
+    const unsigned long long signals = ct::telemetry::stats_of<signal_t>().checks;
+    letter_t l = B;
+    signal_t s1 = GO, s2 = STOP;
+    (void)l; (void)s1; (void)s2;
+    CHECK(ct::telemetry::stats_of<letter_t>().checks - letters == 1);
+    CHECK(ct::telemetry::stats_of<signal_t>().checks - signals == 2);
+  }
+
+  SECTION("dumps") {
+    std::ostringstream text, json;
+    ct::telemetry::dump_text(text);
+    ct::telemetry::dump_json(json);
+    CHECK(text.str().find("RangeConstrained<int, -7, 7> checks=") != std::string::npos);
+    CHECK(json.str().find("{\"type\": \"int\", \"first\": -7, \"last\": 7, \"checks\": ") != std::string::npos);
+  }
+}
+#endif
+
+#if defined(CT_FLIGHT_RECORDER)
+TEST_CASE("flight recorder") {
+  typedef ct::RangeConstrained<int, 100, 200> recorded_t;
+
+  for (int i = 0; i < CT_FLIGHT_RECORDER_SIZE + 3; ++i) {
+    try { recorded_t r = -i; (void)r; } catch (const ct::constraint_error_base&) {}
+  }
+
+  std::vector<ct::recorder::violation_record> records(1024);
+  records.resize(ct::recorder::collect(&records[0], records.size()));
+
+  /* Only the last CT_FLIGHT_RECORDER_SIZE violations of this thread are kept */
+  size_t found = 0;
+  long long lowest = 0;
+  for (size_t i = 0; i < records.size(); ++i) {
+    if (records[i].type == &recorded_t::descriptor()) {
+      found++;
+      lowest = records[i].value < lowest ? records[i].value : lowest;
+      CHECK(records[i].caller != nullptr);
+    }
+  }
+  CHECK(found == CT_FLIGHT_RECORDER_SIZE);
+  CHECK(lowest == -(CT_FLIGHT_RECORDER_SIZE + 2));
+
+  SECTION("dump") {
+    FILE* file = tmpfile();
+    REQUIRE(file != nullptr);
+    ct::recorder::dump(fileno(file));
+    rewind(file);
+    char line[256];
+    bool matched = false;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+      matched = matched || string(line).find("type=int[100, 200] value=-3 caller=0x") != string::npos;
+    }
+    fclose(file);
+    CHECK(matched);
+  }
+}
+#endif
+
+#if defined(CT_SOURCE_LOCATION)
+TEST_CASE("violations per call site") {
+  typedef ct::RangeConstrained<int, 0, 9> digit_t;
+
+  digit_t d = 5;
+  unsigned assign_line = 0, add_line = 0;
+  for (int i = 0; i < 3; ++i) {
+    try { assign_line = __LINE__; d = 10 + i; } catch (const ct::constraint_error_base&) {}
+  }
+  try { add_line = __LINE__; d += 7; } catch (const digit_t::constraint_error& e) {
+    CHECK(e.where().line == add_line);
+    CHECK(string(e.where().file) == __FILE__);
+  }
+
+  unsigned long long at_assign = 0, at_add = 0;
+  std::vector<ct::sites::site_stats> all = ct::sites::snapshot();
+  for (size_t i = 0; i < all.size(); ++i) {
+    if (all[i].type == &digit_t::descriptor()) {
+      at_assign += all[i].where.line == assign_line ? all[i].violations : 0;
+      at_add += all[i].where.line == add_line ? all[i].violations : 0;
+    }
+  }
+  CHECK(at_assign >= 3);
+  CHECK(at_add >= 1);
+
+  std::ostringstream text;
+  ct::sites::dump_text(text);
+  std::ostringstream expected;
+  expected << __FILE__ << ':' << add_line;
+  CHECK(text.str().find(expected.str()) != std::string::npos);
+  CHECK(text.str().find("RangeConstrained<int, 0, 9> violations=") != std::string::npos);
+}
+#endif
+
+#if defined(CT_ASYNC_LOG)
+/* Lines of the file, empty when it does not exist */
+static vector<string> read_lines(const string& path) {
+  vector<string> lines;
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    return lines;
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    lines.push_back(line);
+  }
+  fclose(file);
+  return lines;
+}
+
+static size_t count_matching(const vector<string>& lines, const string& text) {
+  size_t count = 0;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    count += lines[i].find(text) != string::npos ? 1 : 0;
+  }
+  return count;
+}
+
+TEST_CASE("asynchronous violation log") {
+  typedef ct::RangeConstrained<int, 300, 400> logged_t;
+  const string path = "ct_test_violations.log";
+  for (int i = 0; i <= 3; ++i) {
+    remove((i == 0 ? path : path + "." + to_string(i)).c_str());
+  }
+
+  ct::logger::options opts;
+  opts.path = path;
+  opts.poll_interval_ms = 1;
+
+  SECTION("every violation is written") {
+    opts.per_type_per_second = 0;
+    opts.per_site_per_second = 0;
+    REQUIRE(ct::logger::start(opts));
+    CHECK_FALSE(ct::logger::start(opts));
+    for (int i = 0; i < 5; ++i) {
+      try { logged_t l = 401 + i; (void)l; } catch (const ct::constraint_error_base&) {}
+    }
+    ct::logger::stop();
+
+    vector<string> lines = read_lines(path);
+    CHECK(count_matching(lines, "type=int[300, 400] value=40") == 5);
+    CHECK(count_matching(lines, "type=int[300, 400] value=405") == 1);
+#if defined(CT_SOURCE_LOCATION)
+    CHECK(count_matching(lines, string(" at ") + __FILE__ + ":") == 5);
+#endif
+  }
+
+  SECTION("rate limit") {
+    opts.per_type_per_second = 2;
+    opts.per_site_per_second = 0;
+    REQUIRE(ct::logger::start(opts));
+    for (int i = 0; i < 10; ++i) {
+      try { logged_t l = 500; (void)l; } catch (const ct::constraint_error_base&) {}
+    }
+    ct::logger::stop();
+
+    /* The violations may span two seconds */
+    vector<string> lines = read_lines(path);
+    size_t written = count_matching(lines, "value=500");
+    CHECK(written >= 2);
+    CHECK(written <= 4);
+    unsigned long long suppressed = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+      size_t at = lines[i].find("suppressed=");
+      suppressed += at == string::npos ? 0 : stoull(lines[i].substr(at + 11));
+    }
+    CHECK(written + suppressed == 10);
+  }
+
+  SECTION("late records count in the current second") {
+    opts.per_type_per_second = 1;
+    opts.per_site_per_second = 0;
+    REQUIRE(ct::logger::start(opts));
+    const long long seconds[] = { 11, 10, 11, 12 };
+    for (int i = 0; i < 4; ++i) {
+      ct::logger::detail::log_record r = { seconds[i] * 1000000000LL, 500 + i, &logged_t::descriptor(), ct::source_location() };
+      REQUIRE(ct::logger::detail::writer::instance()->records.push(r));
+    }
+    ct::logger::stop();
+
+    vector<string> lines = read_lines(path);
+    CHECK(count_matching(lines, "value=500") == 1);
+    CHECK(count_matching(lines, "value=503") == 1);
+    CHECK(count_matching(lines, "ts=11000000000 suppressed=2") == 1);
+    CHECK(count_matching(lines, "ts=10000000000") == 0);
+  }
+
+  SECTION("rotation") {
+    opts.per_type_per_second = 0;
+    opts.per_site_per_second = 0;
+    opts.max_file_size = 256;
+    opts.max_files = 2;
+    REQUIRE(ct::logger::start(opts));
+    for (int i = 0; i < 50; ++i) {
+      try { logged_t l = 1000 + i; (void)l; } catch (const ct::constraint_error_base&) {}
+    }
+    ct::logger::stop();
+
+    vector<string> current = read_lines(path);
+    CHECK(count_matching(current, "value=1049") == 1);
+    CHECK(read_lines(path + ".1").size() > 0);
+    CHECK(read_lines(path + ".2").size() > 0);
+    CHECK(read_lines(path + ".3").empty());
+  }
+
+  CHECK(ct::logger::dropped() == 0);
+  for (int i = 0; i <= 3; ++i) {
+    remove((i == 0 ? path : path + "." + to_string(i)).c_str());
+  }
+}
+#endif
+
+#if defined(CT_SAMPLING)
+TEST_CASE("value sampling") {
+  typedef ct::RangeConstrained<int, -1000, 1000> sampled_t;
+
+  /* Each value is checked CT_SAMPLING_PERIOD times in a row, so it is sampled exactly once */
+  for (int v = -10; v < 90; ++v) {
+    for (int i = 0; i < CT_SAMPLING_PERIOD; ++i) {
+      sampled_t s = v;
+      (void)s;
+    }
+  }
+
+  std::vector<ct::sampling::value_stats> all = ct::sampling::snapshot();
+  const ct::sampling::value_stats* stats = nullptr;
+  for (size_t i = 0; i < all.size(); ++i) {
+    stats = all[i].type.first == -1000 && all[i].type.last == 1000 ? &all[i] : stats;
+  }
+  REQUIRE(stats != nullptr);
+  CHECK(stats->samples == 100);
+  CHECK(stats->min == -10);
+  CHECK(stats->max == 89);
+  CHECK(stats->below + stats->above == 0);
+
+  unsigned long long bucketed = 0;
+  for (size_t b = 0; b < CT_SAMPLING_BUCKETS; ++b) {
+    bucketed += stats->buckets[b];
+  }
+  CHECK(bucketed == 100);
+
+  ct::sampling::suggestion s = ct::sampling::suggest(*stats);
+  CHECK(s.first == -10);
+  CHECK(s.last == 89);
+  CHECK(s.bits == 8);
+  CHECK(s.offset_bits == 7);
+
+  std::ostringstream text;
+  ct::sampling::report(text);
+  CHECK(text.str().find("RangeConstrained<int, -1000, 1000> samples=100 suggested=[-10, 89] bits=8 offset_bits=7") !=
+        std::string::npos);
+
+  /* Subtypes with the same base type and bounds are sampled apart */
+  enum level { LOW, MIDDLE, HIGH };
+  enum answer { NO, MAYBE, YES };
+  for (int i = 0; i < CT_SAMPLING_PERIOD; ++i) {
+    ct::RangeConstrained<level, LOW, HIGH> l = LOW;
+    (void)l;
+  }
+  for (int i = 0; i < CT_SAMPLING_PERIOD; ++i) {
+    ct::RangeConstrained<answer, NO, YES> a = YES;
+    (void)a;
+  }
+  all = ct::sampling::snapshot();
+  int enums = 0;
+  for (size_t i = 0; i < all.size(); ++i) {
+    if (std::string(all[i].type.base_type) == "enum" && all[i].type.first == 0 && all[i].type.last == 2) {
+      ++enums;
+      CHECK(all[i].min == all[i].max);
+    }
+  }
+  CHECK(enums == 2);
+}
+#endif
+
+#if defined(CT_PARANOID)
+struct corruption_detected {
+  long long value;
+};
+
+static void throwing_corruption_handler(const ct::type_descriptor&, long long value, const void*) {
+  throw corruption_detected{ value };
+}
+
+TEST_CASE("paranoid reads") {
+  struct record {
+    month_t month;
+    int day;
+  };
+
+  ct::paranoid::handler previous = ct::paranoid::set_handler(&throwing_corruption_handler);
+  record r;
+  r.month = 5;
+  CHECK(r.month == 5);
+
+  SECTION("overwritten by C code") {
+    memset((void*)&r.month, 0x7f, sizeof(r.month));
+    CHECK_THROWS_AS(f2(r.month), corruption_detected);
+    try {
+      short s = r.month;
+      (void)s;
+    } catch (const corruption_detected& e) {
+      CHECK(e.value == 0x7f7f);
+    }
+  }
+
+  SECTION("stored unchecked") {
+    month_t m(ct::unchecked, 13);
+    CHECK_THROWS_AS(f1(m), corruption_detected);
+  }
+
+  ct::paranoid::set_handler(previous);
+}
+#endif
+
+namespace {
+
+/// The xorshift generator of the bulk tests.
+class bulk_rng {
+  unsigned long long x = 88172645463325252ull;
+
+public:
+  unsigned long long operator()() {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    return x;
+  }
+
+  /// A value in [low, high].
+  template<class T>
+  T between(T low, T high) {
+    const unsigned long long span = (unsigned long long)high - (unsigned long long)low;
+    const unsigned long long v = (*this)();
+    return (T)((unsigned long long)low + (span == ~0ull ? v : v % (span + 1)));
+  }
+};
+
+/// Sets the level of the public bulk functions for a scope.
+class simd_level_scope {
+  const ct::simd_level saved;
+
+public:
+  explicit simd_level_scope(ct::simd_level level) : saved(ct::set_simd_level(level)) {}
+  ~simd_level_scope() { ct::set_simd_level(saved); }
+};
+
+}
+
+/**
+ * Calls check(level, size, rng) at every level this processor supports, for
+ * buffers from empty to a few vectors long and then of the extra sizes. The
+ * public bulk functions run at that level during the call, and rng starts
+ * from the same seed each time, so every level sees the same values.
+ */
+template<class Check>
+static void for_each_simd_level_and_size(Check check, std::initializer_list<size_t> extra = {}) {
+  vector<size_t> sizes = { 0, 1, 15, 16, 17, 100, 1000 };
+  sizes.insert(sizes.end(), extra);
+  for (int level = ct::SIMD_SCALAR; level <= ct::detail::detected_simd_level(); ++level) {
+    simd_level_scope scope((ct::simd_level)level);
+    for (size_t size : sizes) {
+      bulk_rng rng;
+      check((ct::simd_level)level, size, rng);
+    }
+  }
+}
+
+/// Runs filter and select_indices at level and compares them to a plain loop.
+template<class RC>
+static void check_filter(ct::simd_level level, const vector<typename RC::value_type>& src) {
+  vector<typename RC::value_type> expected;
+  vector<uint32_t> expected_indices;
+  for (size_t i = 0; i < src.size(); ++i) {
+    if (!(src[i] < RC::first()) && !(src[i] > RC::last())) {
+      expected.push_back(src[i]);
+      expected_indices.push_back((uint32_t)i);
+    }
+  }
+  vector<RC> dst(src.size());
+  vector<uint32_t> indices(src.size());
+  size_t count = ct::detail::filter_at<RC>(level, src.data(), src.size(), dst.data());
+  size_t selected = ct::detail::select_indices_at<RC>(level, src.data(), src.size(), indices.data());
+  vector<typename RC::value_type> kept(dst.begin(), dst.begin() + count);
+  indices.resize(selected);
+  CHECK(kept == expected);
+  CHECK(indices == expected_indices);
+}
+
+template<class T, T First, T Last>
+static void check_filter_sizes(T low, T high) {
+  for_each_simd_level_and_size([=](ct::simd_level level, size_t size, bulk_rng& rng) {
+    vector<T> src(size);
+    for (T& v : src) {
+      v = rng.between(low, high);
+    }
+    check_filter<ct::RangeConstrained<T, First, Last> >(level, src);
+  });
+}
+
+TEST_CASE("bulk filter") {
+  check_filter_sizes<int, -100, 100>(-300, 300);
+  check_filter_sizes<unsigned, 10, 3000000000u>(0, 4000000000u);
+  check_filter_sizes<long long, -5, 1LL << 40>(-1000, 1LL << 41);
+  check_filter_sizes<unsigned long long, 1ULL << 63, ~0ULL>(0, ~0ULL);
+  check_filter_sizes<short, 1, 12>(-20, 20);
+  check_filter_sizes<char, 'a', 'z'>('A', 'z');
+  check_filter_sizes<enum E, C, F>(A, G);
+
+  SECTION("public interface") {
+    typedef ct::RangeConstrained<int, 1, 12> int_month_t;
+    const int raw[] = { 5, -1, 12, 13, 1, 0 };
+    int_month_t months[6];
+    uint32_t indices[6];
+    REQUIRE(ct::filter<int_month_t>(raw, 6, months) == 3);
+    CHECK(months[0] == 5);
+    CHECK(months[1] == 12);
+    CHECK(months[2] == 1);
+    REQUIRE(ct::select_indices<int_month_t>(raw, 6, indices) == 3);
+    CHECK(indices[0] == 0);
+    CHECK(indices[1] == 2);
+    CHECK(indices[2] == 4);
+#if defined(__cpp_lib_span)
+    std::span<int_month_t> selected = ct::filter<int_month_t>(std::span<const int>(raw), std::span<int_month_t>(months));
+    CHECK(selected.size() == 3);
+    CHECK(selected.data() == months);
+#endif
+  }
+}
+
+/// Converts src at level and compares the result to a plain loop.
+template<class RC, class Src>
+static void check_convert(ct::simd_level level, const vector<Src>& src) {
+  ct::bulk_result expected = { src.size(), 0 };
+  for (size_t i = 0; i < src.size(); ++i) {
+    const long long v = (long long)src[i];
+    if (v < (long long)RC::first() || v > (long long)RC::last()) {
+      if (expected.violations++ == 0) {
+        expected.first_violation = i;
+      }
+    }
+  }
+  vector<RC> dst(src.size());
+  ct::bulk_result result = ct::detail::convert_at<RC>(level, src.data(), src.size(), dst.data());
+  REQUIRE(result.first_violation == expected.first_violation);
+  REQUIRE(result.violations == expected.violations);
+  bool converted = true, unchanged = true;
+  for (size_t i = 0; i < src.size(); ++i) {
+    if (i < result.first_violation) {
+      converted = converted && (long long)dst[i] == (long long)src[i];
+    } else {
+      unchanged = unchanged && dst[i] == RC::first();
+    }
+  }
+  CHECK(converted);
+  CHECK(unchanged);
+}
+
+template<class RC, class Src>
+static void check_convert_sizes(Src valid, Src invalid) {
+  for_each_simd_level_and_size([=](ct::simd_level level, size_t size, bulk_rng&) {
+    vector<Src> src(size);
+    for (size_t i = 0; i < size; ++i) {
+      src[i] = (Src)((long long)valid - (long long)(i % 7));
+    }
+    check_convert<RC>(level, src);
+    if (size > 0) {
+      src[size - 1] = invalid;
+      check_convert<RC>(level, src);
+      src[size / 2] = invalid;
+      src[size / 3] = invalid;
+      check_convert<RC>(level, src);
+    }
+  });
+}
+
+TEST_CASE("bulk conversion") {
+  check_convert_sizes<ct::RangeConstrained<signed char, -100, 100> >(100, 101);
+  check_convert_sizes<ct::RangeConstrained<signed char, -100, 100> >(-94, -101);
+  check_convert_sizes<ct::RangeConstrained<unsigned char, 10, 255> >(255, 256);
+  check_convert_sizes<ct::RangeConstrained<short, -30000, 30000> >(30000, 40000);
+  check_convert_sizes<ct::RangeConstrained<unsigned short, 0, 65535> >(65535, -1);
+  check_convert_sizes<ct::RangeConstrained<int, 0, 1000> >(1000u, 3000000000u);
+  check_convert_sizes<ct::RangeConstrained<unsigned char, 6, 200> >(200u, 4000000000u);
+  check_convert_sizes<ct::RangeConstrained<unsigned, 6, 200> >(200LL, -1LL);
+
+  SECTION("source interval fits") {
+    typedef ct::RangeConstrained<signed char, 1, 12> small_month_t;
+    typedef ct::RangeConstrained<int, -40000, 40000> wide_t;
+    CHECK((ct::detail::convert_traits<small_month_t, month_t>::fits()));
+    CHECK((ct::detail::convert_traits<wide_t, short>::fits()));
+    CHECK_FALSE((ct::detail::convert_traits<small_month_t, short>::fits()));
+    month_t months[3] = { 1, 7, 12 };
+    small_month_t small[3];
+    ct::bulk_result result = ct::convert(months, 3, small);
+    CHECK(result.first_violation == 3);
+    CHECK(result.violations == 0);
+    CHECK(small[1] == 7);
+  }
+
+  SECTION("empty range") {
+    const unsigned src[] = { 0, 1, 2 };
+    ct::RangeConstrained<int, -10, -1> dst[3];
+    ct::bulk_result result = ct::convert(src, 3, dst);
+    CHECK(result.first_violation == 0);
+    CHECK(result.violations == 3);
+  }
+}
+
+/// Runs one bulk operation at level and compares it to a plain loop in 128 bits.
+template<class RC, int Op, bool Elementwise>
+static void check_arithmetic(ct::simd_level level, const vector<typename RC::value_type>& values,
+                             const vector<typename RC::value_type>& others, long long scalar, ct::bulk_mode mode) {
+  typedef typename RC::value_type T;
+  const long long first = (long long)RC::first(), last = (long long)RC::last();
+  vector<__int128> exact(values.size());
+  ct::bulk_result expected = { values.size(), 0 };
+  for (size_t i = 0; i < values.size(); ++i) {
+    const __int128 x = (long long)values[i], y = Elementwise ? (long long)others[i] : scalar;
+    exact[i] = Op == ct::detail::OP_ADD ? x + y : Op == ct::detail::OP_SUB ? x - y :
+               Op == ct::detail::OP_MUL ? x * y : Op == ct::detail::OP_SHL ? x * ((__int128)1 << y) : x >> y;
+    if (exact[i] < first || exact[i] > last) {
+      if (expected.violations++ == 0) {
+        expected.first_violation = i;
+      }
+    }
+  }
+  vector<RC> data(values.begin(), values.end());
+  ct::bulk_result result = ct::detail::arithmetic_at<Op, Elementwise>(level, data.data(), data.size(),
+                                                                      Elementwise ? others.data() : nullptr,
+                                                                      Elementwise ? 0 : scalar, mode);
+  REQUIRE(result.first_violation == expected.first_violation);
+  REQUIRE(result.violations == expected.violations);
+  bool matches = true;
+  for (size_t i = 0; i < values.size(); ++i) {
+    const long long stored = (long long)(T)data[i];
+    if (mode == ct::BULK_SATURATE) {
+      matches = matches && stored == (exact[i] < first ? first : exact[i] > last ? last : exact[i]);
+    } else {
+      matches = matches && stored == (expected.violations == 0 ? exact[i] : (long long)values[i]);
+    }
+  }
+  CHECK(matches);
+}
+
+template<class RC>
+static void check_arithmetic_sizes(long long scalar, int shift) {
+  typedef typename RC::value_type T;
+  for_each_simd_level_and_size([=](ct::simd_level level, size_t size, bulk_rng& rng) {
+    const ct::bulk_mode modes[] = { ct::BULK_ALL_OR_NOTHING, ct::BULK_SATURATE };
+    vector<T> values(size), others(size);
+    const unsigned long long span = (unsigned long long)((long long)RC::last() - (long long)RC::first());
+    for (size_t i = 0; i < size; ++i) {
+      const unsigned long long x = rng();
+      values[i] = (T)((long long)RC::first() + (long long)(x % (span + 1)));
+      others[i] = (T)((long long)RC::first() + (long long)((x >> 20) % (span + 1)));
+    }
+    for (ct::bulk_mode mode : modes) {
+      check_arithmetic<RC, ct::detail::OP_ADD, false>(level, values, others, scalar, mode);
+      check_arithmetic<RC, ct::detail::OP_ADD, true>(level, values, others, 0, mode);
+      check_arithmetic<RC, ct::detail::OP_SUB, false>(level, values, others, scalar, mode);
+      check_arithmetic<RC, ct::detail::OP_SUB, true>(level, values, others, 0, mode);
+      check_arithmetic<RC, ct::detail::OP_MUL, false>(level, values, others, scalar, mode);
+      check_arithmetic<RC, ct::detail::OP_MUL, true>(level, values, others, 0, mode);
+      check_arithmetic<RC, ct::detail::OP_SHL, false>(level, values, others, shift, mode);
+      check_arithmetic<RC, ct::detail::OP_SHR, false>(level, values, others, shift, mode);
+    }
+    if (size > 0) {
+      // Results that are all in range.
+      vector<T> small(size, (T)RC::first());
+      check_arithmetic<RC, ct::detail::OP_ADD, false>(level, small, others, 0, ct::BULK_ALL_OR_NOTHING);
+    }
+  }, { 5000 });
+}
+
+TEST_CASE("bulk arithmetic") {
+  check_arithmetic_sizes<ct::RangeConstrained<signed char, -100, 100> >(3, 1);
+  check_arithmetic_sizes<ct::RangeConstrained<unsigned char, 0, 250> >(2, 1);
+  check_arithmetic_sizes<month_t>(1, 2);
+  check_arithmetic_sizes<ct::RangeConstrained<unsigned short, 100, 65535> >(2, 3);
+  check_arithmetic_sizes<ct::RangeConstrained<int, -2000, 100000> >(7, 4);
+  check_arithmetic_sizes<ct::RangeConstrained<int, INT_MIN, INT_MAX> >(-3, 31);
+  check_arithmetic_sizes<ct::RangeConstrained<unsigned, 0, 4000000000u> >(2, 5);
+
+  SECTION("public interface") {
+    vector<month_t> months = { 1, 5, 11 };
+    ct::bulk_result result = ct::bulk_add(months.data(), months.size(), 1);
+    CHECK(result.violations == 0);
+    CHECK(months[2] == 12);
+    result = ct::bulk_add(months.data(), months.size(), 1);
+    CHECK(result.first_violation == 2);
+    CHECK(result.violations == 1);
+    CHECK(months[0] == 2);
+    result = ct::bulk_mul(months.data(), months.size(), 3, ct::BULK_SATURATE);
+    CHECK(result.violations == 2);
+    CHECK(months[0] == 6);
+    CHECK(months[1] == 12);
+    ct::bulk_shift(months.data(), months.size(), -1);
+    CHECK(months[0] == 3);
+#if defined(__cpp_lib_span)
+    const short deltas[] = { -2, 0, 0 };
+    result = ct::bulk_sub(std::span<month_t>(months), std::span<const short>(deltas));
+    CHECK(result.violations == 0);
+    CHECK(months[0] == 5);
+#endif
+  }
+}
+
+/// Clamps at level, in place and into a copy, and compares to a plain loop.
+template<class RC>
+static void check_clamp(ct::simd_level level, const vector<typename RC::value_type>& src) {
+  typedef typename RC::value_type T;
+  vector<T> expected(src);
+  size_t expected_modified = 0;
+  for (T& v : expected) {
+    if (v < RC::first() || v > RC::last()) {
+      v = v < RC::first() ? RC::first() : RC::last();
+      ++expected_modified;
+    }
+  }
+  vector<T> data(src);
+  size_t modified = 0;
+  ct::detail::clamp_at<RC>(level, data.data(), data.size(), (RC*)data.data(), &modified);
+  CHECK(data == expected);
+  CHECK(modified == expected_modified);
+
+  vector<RC> copy(src.size());
+  ct::detail::clamp_at<RC>(level, src.data(), src.size(), copy.data(), nullptr);
+  CHECK(vector<T>(copy.begin(), copy.end()) == expected);
+}
+
+template<class T, T First, T Last>
+static void check_clamp_sizes(T low, T high) {
+  for_each_simd_level_and_size([=](ct::simd_level level, size_t size, bulk_rng& rng) {
+    vector<T> src(size);
+    for (T& v : src) {
+      v = rng.between(low, high);
+    }
+    check_clamp<ct::RangeConstrained<T, First, Last> >(level, src);
+  }, { 10000 });
+}
+
+TEST_CASE("bulk clamping") {
+  check_clamp_sizes<signed char, -100, 100>(-128, 127);
+  check_clamp_sizes<unsigned char, 10, 200>(0, 255);
+  check_clamp_sizes<char, 'a', 'z'>('A', 'z');
+  check_clamp_sizes<short, 1, 12>(-20, 20);
+  check_clamp_sizes<unsigned short, 1000, 60000>(0, 65535);
+  check_clamp_sizes<int, -2000, 100000>(-5000, 200000);
+  check_clamp_sizes<unsigned, 10, 3000000000u>(0, 4000000000u);
+  check_clamp_sizes<long long, -5, 1LL << 40>(-1000, 1LL << 41);
+  check_clamp_sizes<unsigned long long, 1ULL << 63, ~0ULL - 5>(0, ~0ULL);
+  check_clamp_sizes<enum E, C, F>(A, G);
+
+  SECTION("public interface") {
+    short raw[] = { 0, 5, 13, -4 };
+    size_t modified = 0;
+    month_t* months = ct::clamp_into<month_t>(raw, 4, &modified);
+    CHECK(modified == 3);
+    CHECK(months[0] == 1);
+    CHECK(months[1] == 5);
+    CHECK(months[2] == 12);
+    CHECK((void*)months == (void*)raw);
+
+    const short feed[] = { 40, 7 };
+    month_t copy[2];
+    ct::clamp_copy<month_t>(feed, 2, copy);
+    CHECK(copy[0] == 12);
+    CHECK(copy[1] == 7);
+    CHECK(feed[0] == 40);
+#if defined(__cpp_lib_span)
+    short more[] = { 20, 2 };
+    std::span<month_t> clamped = ct::clamp_into<month_t>(std::span<short>(more));
+    CHECK(clamped.size() == 2);
+    CHECK(clamped[0] == 12);
+#endif
+  }
+}
+
+/// Reduces at level and compares to plain loops.
+template<class RC>
+static void check_reductions(ct::simd_level level, const vector<RC>& data) {
+  typedef typename RC::value_type T;
+  __int128 total = 0;
+  T smallest = RC::last(), largest = RC::first();
+  for (const RC& v : data) {
+    total += (T)v;
+    smallest = (T)v < smallest ? (T)v : smallest;
+    largest = (T)v > largest ? (T)v : largest;
+  }
+  CHECK((__int128)ct::detail::sum_at(level, data.data(), data.size()) == total);
+  CHECK(ct::detail::extreme_at<RC, false>(level, data.data(), data.size()) == smallest);
+  CHECK(ct::detail::extreme_at<RC, true>(level, data.data(), data.size()) == largest);
+  CHECK((__int128)ct::parallel_sum(data.data(), data.size(), 3) == total);
+}
+
+template<class RC>
+static void check_reduction_sizes() {
+  for_each_simd_level_and_size([](ct::simd_level level, size_t size, bulk_rng& rng) {
+    vector<RC> data(size);
+    for (RC& v : data) {
+      v = RC(ct::unchecked, rng.between(RC::first(), RC::last()));
+    }
+    check_reductions(level, data);
+    // Every value at the largest magnitude, the worst case of the accumulators.
+    check_reductions(level, vector<RC>(size, RC::last()));
+    check_reductions(level, vector<RC>(size, RC::first()));
+  }, { 300000 });
+}
+
+TEST_CASE("bulk reductions") {
+  typedef ct::RangeConstrained<uint8_t, 0, 5> seats_t;
+  typedef ct::RangeConstrained<int32_t, -2000, 100000> altitude_t;
+  CHECK((std::is_same<ct::detail::sum_traits<seats_t>::accumulator, uint16_t>::value));
+  CHECK((std::is_same<ct::detail::sum_traits<altitude_t>::accumulator, int32_t>::value));
+  CHECK((std::is_same<ct::detail::sum_traits<altitude_t>::result, long long>::value));
+  // 2^32 values at the bounds always fit in the total.
+  CHECK(ct::detail::sum_traits<ct::RangeConstrained<int, -2147483647, 0> >::max_count() >= (1ull << 32));
+  CHECK(ct::detail::sum_traits<ct::RangeConstrained<int, INT_MIN, INT_MAX> >::max_count() >= (1ull << 32));
+  CHECK(ct::detail::sum_traits<ct::RangeConstrained<unsigned, 0, UINT_MAX> >::max_count() >= (1ull << 32));
+  CHECK(ct::detail::sum_traits<ct::RangeConstrained<long long, -(1LL << 32), 0> >::max_count() >= (1ull << 32));
+
+  check_reduction_sizes<seats_t>();
+  check_reduction_sizes<month_t>();
+  check_reduction_sizes<ct::RangeConstrained<signed char, -128, 127> >();
+  check_reduction_sizes<ct::RangeConstrained<unsigned short, 0, 65535> >();
+  check_reduction_sizes<altitude_t>();
+  check_reduction_sizes<ct::RangeConstrained<int, INT_MIN, INT_MAX> >();
+  check_reduction_sizes<ct::RangeConstrained<unsigned, 0, UINT_MAX> >();
+  check_reduction_sizes<ct::RangeConstrained<long long, -1000000, 1000000> >();
+  check_reduction_sizes<ct::RangeConstrained<long long, LLONG_MIN, LLONG_MAX> >();
+
+  SECTION("public interface") {
+    const month_t months[] = { 3, 12, 1, 7 };
+    CHECK(ct::sum(months, 4) == 23);
+    CHECK(ct::min(months, 4) == 1);
+    CHECK(ct::max(months, 4) == 12);
+    CHECK(ct::mean(months, 4) == 5.75);
+    CHECK(ct::min(months, 0) == 12);
+    CHECK(ct::mean(months, 0) != ct::mean(months, 0));
+#if defined(__cpp_lib_span)
+    CHECK(ct::sum<month_t>(std::span<const month_t>(months)) == 23);
+#endif
+  }
+}
+
+TEST_CASE("bulk parallel sum joins its threads when an exception unwinds") {
+  std::atomic<bool> finished(false);
+  std::vector<std::thread> workers;
+  try {
+    ct::detail::thread_joiner joiner(workers);
+    workers.emplace_back([&finished]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      finished = true;
+    });
+    throw std::runtime_error("spawn failed");
+  } catch (const std::runtime_error&) {
+    CHECK(finished);
+  }
+  CHECK_FALSE(workers[0].joinable());
+}
+
+template<class RC, class URBG>
+static void check_uniform() {
+  typedef typename RC::value_type T;
+  for_each_simd_level_and_size([](ct::simd_level level, size_t size, bulk_rng&) {
+    URBG reference_rng(2014), rng(2014);
+    vector<RC> reference(size, RC::first()), data(size, RC::first());
+    ct::detail::fill_uniform_at(ct::SIMD_SCALAR, reference.data(), size, reference_rng);
+    ct::detail::fill_uniform_at(level, data.data(), size, rng);
+    size_t out_of_range = 0;
+    for (const RC& v : data) {
+      out_of_range += ((T)v < RC::first() || (T)v > RC::last()) ? 1 : 0;
+    }
+    CHECK(out_of_range == 0);
+    CHECK(std::equal(data.begin(), data.end(), reference.begin(),
+                     [](const RC& a, const RC& b) { return (T)a == (T)b; }));
+  }, { 5000 });
+  URBG rng(1);
+  for (int i = 0; i < 1000; ++i) {
+    const T v = ct::uniform<RC>(rng);
+    CHECK((v >= RC::first() && v <= RC::last()));
+  }
+}
+
+TEST_CASE("bulk uniform") {
+  typedef ct::RangeConstrained<enum E, B, F> letter_t;
+  check_uniform<month_t, std::mt19937>();
+  check_uniform<month_t, std::minstd_rand>();
+  check_uniform<letter_t, std::mt19937_64>();
+  check_uniform<ct::RangeConstrained<signed char, -128, 127>, std::mt19937>();
+  check_uniform<ct::RangeConstrained<int, -5, 3000000>, std::mt19937_64>();
+  check_uniform<ct::RangeConstrained<int, INT_MIN, INT_MAX>, std::mt19937>();
+  check_uniform<ct::RangeConstrained<unsigned, 0, UINT_MAX>, std::minstd_rand>();
+  check_uniform<ct::RangeConstrained<long long, -1000000, 1000000>, std::mt19937>();
+  check_uniform<ct::RangeConstrained<long long, -10, 10000000000LL>, std::mt19937>();
+  check_uniform<ct::RangeConstrained<long long, LLONG_MIN, LLONG_MAX>, std::mt19937_64>();
+  check_uniform<ct::RangeConstrained<unsigned long long, 1, ULLONG_MAX>, std::minstd_rand>();
+
+  // A range whose size does not divide 2^32 rejects a few words, 3 << 30 rejects one in four.
+  typedef ct::RangeConstrained<unsigned, 0, (3u << 30) - 1> rejecting_t;
+  check_uniform<rejecting_t, std::mt19937>();
+
+  SECTION("every value about equally often") {
+    std::mt19937 rng(42);
+    vector<month_t> months(120000, 1);
+    ct::fill_uniform(months.data(), months.size(), rng);
+    size_t counts[13] = {};
+    for (const month_t& m : months) {
+      ++counts[(short)m];
+    }
+    for (int m = 1; m <= 12; ++m) {
+      CHECK(counts[m] > 9500);
+      CHECK(counts[m] < 10500);
+    }
+    size_t quarters[4] = {};
+    vector<rejecting_t> large(40000, 0u);
+    ct::fill_uniform(large.data(), large.size(), rng);
+    for (const rejecting_t& v : large) {
+      ++quarters[(unsigned)v >> 30];
+    }
+    CHECK(quarters[3] == 0);
+    for (int q = 0; q < 3; ++q) {
+      CHECK(quarters[q] > 12800);
+      CHECK(quarters[q] < 13900);
+    }
+  }
+
+  SECTION("public interface") {
+    std::mt19937 rng(7);
+    const month_t m = ct::uniform<month_t>(rng);
+    CHECK((m >= 1 && m <= 12));
+#if defined(__cpp_lib_span)
+    month_t months[50];
+    ct::fill_uniform(std::span<month_t>(months), rng);
+    CHECK(ct::min(months, 50) >= 1);
+#endif
+  }
+}
+
+template<class T, T First, T Last>
+static void check_view_sizes(T low, T high) {
+  typedef ct::RangeConstrained<T, First, Last> RC;
+  for_each_simd_level_and_size([=](ct::simd_level level, size_t size, bulk_rng& rng) {
+    vector<T> data(size);
+    for (T& v : data) {
+      v = rng.between(First, Last);
+    }
+    CHECK(ct::detail::first_violation_at<RC>(level, data.data(), size) == size);
+    CHECK(ct::view_as<RC>(data.data(), size) == reinterpret_cast<const RC*>(data.data()));
+    // One value out of range at each position in turn, the rest in range.
+    for (size_t bad = 0; bad < size; bad += 1 + bad / 4) {
+      const T saved = data[bad];
+      data[bad] = (bad % 2 == 0) ? low : high;
+      CHECK(ct::detail::first_violation_at<RC>(level, data.data(), size) == bad);
+      CHECK_THROWS_AS(ct::view_as<RC>(data.data(), size), typename RC::constraint_error);
+      data[bad] = saved;
+    }
+  });
+}
+
+TEST_CASE("bulk views") {
+  check_view_sizes<signed char, -10, 10>(-11, 11);
+  check_view_sizes<unsigned char, 1, 200>(0, 201);
+  check_view_sizes<short, 1, 12>(0, 13);
+  check_view_sizes<unsigned short, 100, 60000>(99, 60001);
+  check_view_sizes<int, -100, 100>(INT_MIN, 101);
+  check_view_sizes<unsigned, 10, 3000000000u>(9, UINT_MAX);
+  check_view_sizes<long long, -5, 1LL << 40>(LLONG_MIN, (1LL << 40) + 1);
+  check_view_sizes<unsigned long long, 1ULL << 63, ~0ULL - 1>(0, ~0ULL);
+
+  SECTION("public interface") {
+    const short raw[] = { 3, 12, 1, 7 };
+    const month_t* months = ct::view_as<month_t>(raw, 4);
+    CHECK(months[1] == 12);
+    CHECK(ct::first_violation<month_t>(raw, 4) == 4);
+    const short bad[] = { 3, 13 };
+    CHECK_THROWS_WITH(ct::view_as<month_t>(bad, 2), "The value 13 is out of the range [1, 12]");
+    CHECK(ct::view_as_unchecked<month_t>(bad, 2)[0] == 3);
+    // Validated whatever the policy, a sampled copy may skip the check.
+    typedef ct::RangeConstrained<short, 1, 12, ct::sampled<1000> > sampled_month_t;
+    for (int i = 0; i < 10; ++i) {
+      CHECK_THROWS_AS(ct::view_as<sampled_month_t>(bad, 2), sampled_month_t::constraint_error);
+    }
+#if defined(CT_TELEMETRY)
+    // Counted like the violations of a failed check.
+    CHECK(ct::telemetry::stats_of<sampled_month_t>().violations == 10);
+#endif
+#if defined(__cpp_lib_span)
+    std::span<const month_t> view = ct::view_as<month_t>(std::span<const short>(raw));
+    CHECK(view.size() == 4);
+    CHECK(ct::sum(view) == 23);
+    CHECK(ct::first_violation<month_t>(std::span<const short>(bad)) == 1);
+#endif
+  }
+}
+
+namespace {
+
+struct flight_record {
+  month_t month;
+  ct::RangeConstrained<unsigned char, 1, 31> day;
+  ct::RangeConstrained<int, 0, 9999> station;
+  double reading;
+  ct::RangeConstrained<long long, -5, 1LL << 40> altitude;
+  ct::RangeConstrained<enum E, B, F> letter;
+};
+
+template<class Record, class RC>
+static void corrupt(Record& record, RC Record::*member, long long value) {
+  record.*member = RC(ct::unchecked, (typename RC::value_type)value);
+}
+
+}
+
+TEST_CASE("bulk field validation") {
+  typedef flight_record R;
+  for_each_simd_level_and_size([](ct::simd_level level, size_t size, bulk_rng& rng) {
+    vector<R> records(size);
+    vector<bool> expected_month(size), expected_any(size);
+    for (size_t i = 0; i < size; ++i) {
+      const unsigned long long x = rng();
+      switch (x % 16) {
+        case 0: corrupt(records[i], &R::month, 13); expected_month[i] = expected_any[i] = true; break;
+        case 1: corrupt(records[i], &R::day, 0); expected_any[i] = true; break;
+        case 2: corrupt(records[i], &R::station, -1); expected_any[i] = true; break;
+        case 3: corrupt(records[i], &R::altitude, (1LL << 40) + 1); expected_any[i] = true; break;
+        case 4: corrupt(records[i], &R::letter, G); expected_any[i] = true; break;
+        case 5: corrupt(records[i], &R::month, 0); corrupt(records[i], &R::day, 32);
+                expected_month[i] = expected_any[i] = true; break;
+        default: records[i].station = (int)(x % 10000); break;
+      }
+    }
+    vector<uint32_t> month_bad, any_bad;
+    for (size_t i = 0; i < size; ++i) {
+      if (expected_month[i]) month_bad.push_back((uint32_t)i);
+      if (expected_any[i]) any_bad.push_back((uint32_t)i);
+    }
+    vector<uint32_t> bad(size);
+    size_t count = ct::detail::validate_fields_at(level, records.data(), size, bad.data(), &R::month);
+    CHECK(vector<uint32_t>(bad.begin(), bad.begin() + count) == month_bad);
+    count = ct::detail::validate_fields_at(level, records.data(), size, bad.data(),
+                                           &R::month, &R::day, &R::station, &R::altitude, &R::letter);
+    CHECK(vector<uint32_t>(bad.begin(), bad.begin() + count) == any_bad);
+  }, { 255, 256, 257 });
+
+  SECTION("public interface") {
+    R records[3];
+    corrupt(records[1], &R::day, 40);
+    uint32_t bad[3];
+    CHECK(ct::validate_field(records, 3, &R::month, bad) == 0);
+    CHECK(ct::validate_fields(records, 3, bad, &R::month, &R::day) == 1);
+    CHECK(bad[0] == 1);
+#if defined(__cpp_nontype_template_parameter_auto)
+    CHECK(ct::validate_field<&R::day>(records, 3, bad) == 1);
+    CHECK(ct::validate_fields<&R::month, &R::station>(records, 3, bad) == 0);
+#endif
+#if defined(__cpp_lib_span)
+    std::span<uint32_t> found = ct::validate_fields<&R::day, &R::letter>(records, bad);
+    CHECK(found.size() == 1);
+    CHECK(found[0] == 1);
+#endif
+  }
+}
+
+TEST_CASE("bulk dispatch") {
+  const ct::simd_level detected = ct::detail::detected_simd_level();
+  CHECK(ct::get_simd_level() <= detected);
+  CHECK(string(ct::simd_level_name(ct::SIMD_SSE42)) == "sse4.2");
+
+  SECTION("set_simd_level") {
+    const ct::simd_level saved = ct::set_simd_level(ct::SIMD_SCALAR);
+    CHECK(ct::get_simd_level() == ct::SIMD_SCALAR);
+    const int raw[] = { 5, -1, 7, 200, 0, 3 };
+    int kept[6];
+    typedef ct::RangeConstrained<int, 0, 100> percent_t;
+    percent_t* out = reinterpret_cast<percent_t*>(kept);
+    for (int level = ct::SIMD_SCALAR; level <= ct::SIMD_AVX512; ++level) {
+      CHECK(ct::set_simd_level((ct::simd_level)level) <= detected);
+      CHECK(ct::get_simd_level() == (level < detected ? level : detected));
+      CHECK(ct::filter<percent_t>(raw, 6, out) == 4);
+      CHECK(kept[3] == 3);
+    }
+    ct::set_simd_level(saved);
+    CHECK(ct::get_simd_level() == saved);
+  }
+
+  SECTION("CT_SIMD") {
+    setenv("CT_SIMD", "scalar", 1);
+    CHECK(ct::detail::initial_simd_level() == ct::SIMD_SCALAR);
+    setenv("CT_SIMD", "", 1);
+    CHECK(ct::detail::initial_simd_level() == detected);
+    unsetenv("CT_SIMD");
+    CHECK(ct::detail::initial_simd_level() == detected);
+
+    ct::simd_level level = ct::SIMD_SCALAR;
+    CHECK(ct::detail::parse_simd_level("avx2", ct::SIMD_AVX512, level));
+    CHECK(level == ct::SIMD_AVX2);
+    CHECK_FALSE(ct::detail::parse_simd_level("avx512", ct::SIMD_AVX2, level));
+    CHECK_FALSE(ct::detail::parse_simd_level("sse2", ct::SIMD_AVX512, level));
+    CHECK_FALSE(ct::detail::parse_simd_level("AVX2", ct::SIMD_AVX512, level));
+  }
+}